@@ -11,16 +11,18 @@
 #include "access/gist.h"
 #include "mtree_gist.h"
 
-#define MTREE_FLOAT_SIZE		   sizeof(mtree_float)
+#define MTREE_FLOAT_SIZE		   (offsetof(mtree_float, data) + sizeof(float))
 #define DatumGetMtreeFloat(x)	   ((mtree_float*)PG_DETOAST_DATUM(x))
 #define PG_GETARG_MTREE_FLOAT_P(x) DatumGetMtreeFloat(PG_GETARG_DATUM(x))
 #define PG_RETURN_MTREE_FLOAT_P(x) PG_RETURN_POINTER(x)
 
 typedef struct {
+	/* varlena header (do not touch directly!) */
+	int32 vl_len_;
 	int level;
 	double parentDistance;
 	double coveringRadius;
 	float data;
-} __attribute__((packed, aligned(1))) mtree_float;
+} mtree_float;
 
 #endif
@@ -5,10 +5,19 @@
 #include "mtree_float_array.h"
 
 #include "mtree_float_array_util.h"
+#include "mtree_sort.h"
 #include "mtree_util.h"
+#include "common/shortest_dec.h"
+#include "catalog/pg_type.h"
+#include "libpq/pqformat.h"
+#include "utils/memutils.h"
 
 PG_FUNCTION_INFO_V1(mtree_float_array_input);
 PG_FUNCTION_INFO_V1(mtree_float_array_output);
+PG_FUNCTION_INFO_V1(mtree_float_array_recv);
+PG_FUNCTION_INFO_V1(mtree_float_array_send);
+PG_FUNCTION_INFO_V1(mtree_float_array_from_float4);
+PG_FUNCTION_INFO_V1(mtree_float_array_from_float8);
 
 PG_FUNCTION_INFO_V1(mtree_float_array_consistent);
 PG_FUNCTION_INFO_V1(mtree_float_array_union);
@@ -16,9 +25,11 @@ PG_FUNCTION_INFO_V1(mtree_float_array_same);
 
 PG_FUNCTION_INFO_V1(mtree_float_array_penalty);
 PG_FUNCTION_INFO_V1(mtree_float_array_picksplit);
+PG_FUNCTION_INFO_V1(mtree_float_array_sortsupport);
 
 PG_FUNCTION_INFO_V1(mtree_float_array_compress);
 PG_FUNCTION_INFO_V1(mtree_float_array_decompress);
+PG_FUNCTION_INFO_V1(mtree_float_array_fetch);
 
 PG_FUNCTION_INFO_V1(mtree_float_array_distance);
 
@@ -27,540 +38,273 @@ PG_FUNCTION_INFO_V1(mtree_float_array_contained_operator);
 PG_FUNCTION_INFO_V1(mtree_float_array_distance_operator);
 PG_FUNCTION_INFO_V1(mtree_float_array_radius);
 PG_FUNCTION_INFO_V1(mtree_float_array_overlap_operator);
+PG_FUNCTION_INFO_V1(mtree_float_array_native_contains_operator);
+PG_FUNCTION_INFO_V1(mtree_float_array_native_distance_operator);
 
+/*
+ * Parses the comma separated coordinates in a single pass after counting
+ * them, without modifying the input. Accepts everything strtof accepts for a
+ * finite number, so the shortest representations written by the output
+ * function are read back exactly.
+ */
 Datum mtree_float_array_input(PG_FUNCTION_ARGS)
 {
-	char* input = PG_GETARG_CSTRING(0);
-	unsigned char inputLength = strlen(input);
+	const char* input = PG_GETARG_CSTRING(0);
+	const char* position = input;
+	int level = 0;
 
-	if (inputLength == 0) {
+	if (*input == '\0') {
 		ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR), errmsg("The input is an empty string."));
 	}
 
-	char previousInteger = '\0';
-	unsigned char arrayLength = 1;
-	for (unsigned char i = 0; i < inputLength; ++i) {
-		if (isblank(input[i])) {
-			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR), errmsg("The array can not contain space or tab characters."));
-		} else if (input[i] == ',' && previousInteger != '\0') {
-			++arrayLength;
-			previousInteger = '\0';
-		} else if (!isdigit(input[i]) && input[i] != '-' && input[i] != '.' && input[i] != 'l') {
-			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-					errmsg("The array can only contain integers [0-9] and commas [,]."));
+	/* An optional "l,<level>," prefix sets the level of the key. */
+	if (input[0] == 'l' && input[1] == ',') {
+		char* end;
+		errno = 0;
+		long value = strtol(input + 2, &end, 10);
+		if (end == input + 2 || *end != ',' || errno == ERANGE || value < 0 || value > INT_MAX) {
+			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR), errmsg("The level has to be a non-negative integer."));
 		}
-		previousInteger = input[i];
+		level = (int)value;
+		position = end + 1;
 	}
 
-	size_t size = MTREE_FLOAT_ARRAY_SIZE + arrayLength * sizeof(long long) + 1;
-	mtree_float_array* result = (mtree_float_array*)palloc(size);
-
-	char* arrayElement = strtok(input, ",");
-	if (*arrayElement == 'l') {
-		arrayElement = strtok(NULL, ",");
-		result->level = atoi(arrayElement);
-		arrayElement = strtok(NULL, ",");
-		arrayLength -= 2;
-	} else {
-		result->level = 0;
-	}
-	if (arrayElement == NULL) {
-		ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR), errmsg("The input is an empty string."));
+	int arrayLength = 1;
+	for (const char* c = position; *c != '\0'; ++c) {
+		if (*c == ',') {
+			++arrayLength;
+		}
 	}
+
+	size_t size = MTREE_FLOAT_ARRAY_SIZE + arrayLength * sizeof(float);
+	mtree_float_array* result = (mtree_float_array*)palloc0(size);
+
 	for (int i = 0; i < arrayLength; ++i) {
-		result->data[i] = atof(arrayElement);
-		arrayElement = strtok(NULL, ",");
+		char* end;
+
+		if (isspace((unsigned char)*position)) {
+			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR), errmsg("The array can not contain space or tab characters."));
+		}
+
+		errno = 0;
+		result->data[i] = strtof(position, &end);
+		if (end == position || (*end != ',' && *end != '\0')) {
+			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
+					errmsg("The array can only contain numbers separated by commas [,]."));
+		}
+		if (!isfinite(result->data[i])) {
+			ereport(ERROR, errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+					errmsg("The array can only contain finite single precision numbers."));
+		}
+		position = end + 1;
 	}
 
+	result->level = level;
 	result->coveringRadius = 0.0;
-	result->parentDistance = 0.0;
 	result->arrayLength = arrayLength;
+	result->parentDistance = mtree_float_array_reference_distance(result);
 
 	SET_VARSIZE(result, size);
 
 	PG_RETURN_POINTER(result);
 }
 
+/*
+ * Writes the shortest representation of every coordinate that reads back to
+ * the same float (Ryu), directly into the result buffer.
+ */
 Datum mtree_float_array_output(PG_FUNCTION_ARGS)
 {
 	mtree_float_array* output = PG_GETARG_MTREE_FLOAT_ARRAY_P(0);
 
-	unsigned char arrayLength = output->arrayLength;
+	int arrayLength = output->arrayLength;
 
 	StringInfoData stringInfo;
 	initStringInfo(&stringInfo);
+	enlargeStringInfo(&stringInfo, arrayLength * FLOAT_SHORTEST_DECIMAL_LEN);
 
-	char tmp[64];
-	for (unsigned char i = 0; i < arrayLength; ++i) {
-		sprintf(tmp, "%f", output->data[i]);
-		appendStringInfoString(&stringInfo, tmp);
-		if (i != arrayLength - 1) {
-			appendStringInfoChar(&stringInfo, ',');
+	for (int i = 0; i < arrayLength; ++i) {
+		if (i > 0) {
+			stringInfo.data[stringInfo.len++] = ',';
 		}
+		stringInfo.len += float_to_shortest_decimal_buf(output->data[i], stringInfo.data + stringInfo.len);
 	}
+	stringInfo.data[stringInfo.len] = '\0';
 
 	PG_RETURN_CSTRING(stringInfo.data);
 }
 
-Datum mtree_float_array_consistent(PG_FUNCTION_ARGS)
+/*
+ * Binary format: the header of mtree_send_header, the number of coordinates
+ * and the coordinates as float4.
+ */
+Datum mtree_float_array_recv(PG_FUNCTION_ARGS)
 {
-	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
-	mtree_float_array* query = PG_GETARG_MTREE_FLOAT_ARRAY_P(1);
-	StrategyNumber strategyNumber = (StrategyNumber)PG_GETARG_UINT16(2);
-	bool* recheck = (bool*)PG_GETARG_POINTER(4);
-	mtree_float_array* key = DatumGetMtreeFloatArray(entry->key);
-
-	*recheck = false;
-
-	bool returnValue;
-	if (GIST_LEAF(entry)) {
-		switch (strategyNumber) {
-			case GIST_SN_SAME:
-				returnValue = mtree_float_array_equals(key, query);
-				break;
-			case GIST_SN_OVERLAPS:
-				returnValue = mtree_float_array_overlap_distance(key, query);
-				break;
-			case GIST_SN_CONTAINS:
-				returnValue = mtree_float_array_contains_distance(key, query);
-				break;
-			case GIST_SN_CONTAINED_BY:
-				returnValue = mtree_float_array_contained_distance(key, query);
-				break;
-			default:
-				ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-						errmsg("Invalid StrategyNumber for consistent function: %u", strategyNumber));
-				break;
-		}
-	} else {
-		switch (strategyNumber) {
-			case GIST_SN_SAME:
-				returnValue = mtree_float_array_contains_distance(key, query);
-				break;
-			case GIST_SN_OVERLAPS:
-				returnValue = mtree_float_array_overlap_distance(key, query);
-				break;
-			case GIST_SN_CONTAINS:
-				returnValue = mtree_float_array_contains_distance(key, query);
-				break;
-			case GIST_SN_CONTAINED_BY:
-				returnValue = mtree_float_array_overlap_distance(key, query);
-				break;
-			default:
-				ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-						errmsg("Invalid StrategyNumber for consistent function: %u", strategyNumber));
-				break;
-		}
+	StringInfo buffer = (StringInfo)PG_GETARG_POINTER(0);
+	int level;
+	double coveringRadius;
+
+	mtree_receive_header(buffer, &level, &coveringRadius);
+
+	int arrayLength = mtree_receive_length(buffer, 1, (MaxAllocSize - MTREE_FLOAT_ARRAY_SIZE) / sizeof(float),
+										   sizeof(float4));
+	size_t size = MTREE_FLOAT_ARRAY_SIZE + arrayLength * sizeof(float);
+	mtree_float_array* result = (mtree_float_array*)palloc0(size);
+
+	for (int i = 0; i < arrayLength; ++i) {
+		result->data[i] = mtree_receive_coordinate(buffer);
 	}
 
-	PG_RETURN_BOOL(returnValue);
+	result->level = level;
+	result->coveringRadius = coveringRadius;
+	result->arrayLength = arrayLength;
+	result->parentDistance = mtree_float_array_reference_distance(result);
+
+	SET_VARSIZE(result, size);
+
+	PG_RETURN_POINTER(result);
 }
 
-Datum mtree_float_array_union(PG_FUNCTION_ARGS)
+Datum mtree_float_array_send(PG_FUNCTION_ARGS)
 {
-	GistEntryVector* entryVector = (GistEntryVector*)PG_GETARG_POINTER(0);
-	GISTENTRY* entry = entryVector->vector;
-	int ranges = entryVector->n;
-	// elog(INFO, "RANGES: %i", ranges);
-
-	mtree_float_array* entries[ranges];
-	for (int i = 0; i < ranges; ++i) {
-		entries[i] = DatumGetMtreeFloatArray(entry[i].key);
-		// elog(INFO, "%f, %f, %f", entries[i]->data[0], entries[i]->data[1], entries[i]->data[2]);
+	mtree_float_array* value = PG_GETARG_MTREE_FLOAT_ARRAY_P(0);
+	StringInfoData buffer;
+
+	pq_begintypsend(&buffer);
+	mtree_send_header(&buffer, value->level, value->coveringRadius);
+	pq_sendint32(&buffer, (uint32)value->arrayLength);
+	for (int i = 0; i < value->arrayLength; ++i) {
+		pq_sendfloat4(&buffer, value->data[i]);
 	}
 
-	// int searchRange;
-
-	// MtreeUnionStrategy UNION_STRATEGY_FLOAT_ARRAY = MinMaxDistance;
-	// if (PG_HAS_OPCLASS_OPTIONS())
-	// {
-	// 	MtreeOptions* options = (MtreeOptions *) PG_GET_OPCLASS_OPTIONS();
-	// 	UNION_STRATEGY_FLOAT_ARRAY = options->union_strategy;
-	// }
-
-	// switch (UNION_STRATEGY_FLOAT_ARRAY) {
-	// case First:
-	// 	searchRange = 1;
-	// 	break;
-	// case MinMaxDistance:
-	// 	searchRange = ranges;
-	// 	break;
-	// default:
-	// 	ereport(ERROR,
-	// 		errcode(ERRCODE_SYNTAX_ERROR),
-	// 		errmsg("Invalid StrategyNumber for union function: %u", UNION_STRATEGY_FLOAT_ARRAY));
-	// 	break;
-	// }
-
-	// float coveringRadii[searchRange];
-
-	// for (int i = 0; i < searchRange; ++i) {
-	// 	coveringRadii[i] = 0.0;
-
-	// 	for (int j = 0; j < ranges; ++j) {
-	// 		float distance = mtree_float_array_outer_distance(entries[i], entries[j]);
-	// 		float newCoveringRadius;
-
-	// 		if (distance > 0){
-	// 			newCoveringRadius = distance + entries[i]->coveringRadius + (2 * entries[j]->coveringRadius);
-	// 		} else {
-	// 			float exact_distance = mtree_float_array_full_distance(entries[i], entries[j]);
-	// 			float intersect = exact_distance - (entries[i]->coveringRadius + entries[j]->coveringRadius);
-	// 			newCoveringRadius = entries[i]->coveringRadius + (2 * entries[j]->coveringRadius) + intersect;
-	// 		}
-
-	// 		if (coveringRadii[i] < newCoveringRadius) {
-	// 			coveringRadii[i] = newCoveringRadius;
-	// 		}
-	// 	}
-	// }
-
-	// int minimumIndex = 0;
-
-	// for (int i = 1; i < searchRange; ++i) {
-	// 	if (coveringRadii[i] < coveringRadii[minimumIndex]) {
-	// 		minimumIndex = i;
-	// 	}
-	// }
-
-	// mtree_float_array* out = mtree_float_array_deep_copy(entries[minimumIndex]);
-	// out->coveringRadius = coveringRadii[minimumIndex];
-
-	mtree_float_array* out = mtree_float_array_deep_copy(entries[0]);
-	out->coveringRadius += mtree_float_array_outer_distance(entries[0], entries[1]);
-
-	// elog(INFO, "SELECTED: %f, %f, %f", out->data[0], out->data[1], out->data[2]);
-
-	PG_RETURN_MTREE_FLOAT_ARRAY_P(out);
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buffer));
 }
 
-Datum mtree_float_array_same(PG_FUNCTION_ARGS)
+/*
+ * Returns an array of the given length with the header of a value.
+ */
+static mtree_float_array* mtree_float_array_allocate(int arrayLength)
 {
-	mtree_float_array* first = PG_GETARG_MTREE_FLOAT_ARRAY_P(0);
-	mtree_float_array* second = PG_GETARG_MTREE_FLOAT_ARRAY_P(1);
-	PG_RETURN_BOOL(mtree_float_array_equals(first, second));
+	size_t size = MTREE_FLOAT_ARRAY_SIZE + arrayLength * sizeof(float);
+	mtree_float_array* result = (mtree_float_array*)palloc0(size);
+
+	SET_VARSIZE(result, size);
+	result->arrayLength = arrayLength;
+
+	return result;
 }
 
-Datum mtree_float_array_penalty(PG_FUNCTION_ARGS)
+static inline float mtree_float_array_coordinate(double value)
 {
-	GISTENTRY* originalEntry = (GISTENTRY*)PG_GETARG_POINTER(0);
-	GISTENTRY* newEntry = (GISTENTRY*)PG_GETARG_POINTER(1);
-	float* penalty = (float*)PG_GETARG_POINTER(2);
-	mtree_float_array* original = DatumGetMtreeFloatArray(originalEntry->key);
-	mtree_float_array* new = DatumGetMtreeFloatArray(newEntry->key);
+	float coordinate = (float)value;
 
-	double distance = mtree_float_array_outer_distance(original, new);
-	*penalty = distance;
+	if (!isfinite(coordinate)) {
+		ereport(ERROR, errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				errmsg("The array can only contain finite single precision numbers."));
+	}
 
-	PG_RETURN_POINTER(penalty);
+	return coordinate;
 }
 
-/* TODO: Lots of duplicate code. */
-Datum mtree_float_array_picksplit(PG_FUNCTION_ARGS)
+/*
+ * Casts from float4[] and float8[], copying the elements without going
+ * through the text representation.
+ */
+Datum mtree_float_array_from_float4(PG_FUNCTION_ARGS)
 {
-	GistEntryVector* entryVector = (GistEntryVector*)PG_GETARG_POINTER(0);
-	GIST_SPLITVEC* vector = (GIST_SPLITVEC*)PG_GETARG_POINTER(1);
-	OffsetNumber maxOffset = (OffsetNumber)entryVector->n - 1;
-	OffsetNumber numberBytes = (OffsetNumber)(maxOffset + 1) * sizeof(OffsetNumber);
-	OffsetNumber* left;
-	OffsetNumber* right;
-
-	// elog(INFO, "OFFSET: %i", maxOffset);
+	ArrayType* array = PG_GETARG_ARRAYTYPE_P(0);
+	int arrayLength = mtree_native_array_length(array);
+	const float4* elements = (const float4*)ARR_DATA_PTR(array);
+	mtree_float_array* result = mtree_float_array_allocate(arrayLength);
 
-	vector->spl_left = (OffsetNumber*)palloc(numberBytes);
-	left = vector->spl_left;
-	vector->spl_nleft = 0;
+	for (int i = 0; i < arrayLength; ++i) {
+		result->data[i] = mtree_float_array_coordinate(elements[i]);
+	}
+	result->parentDistance = mtree_float_array_reference_distance(result);
 
-	vector->spl_right = (OffsetNumber*)palloc(numberBytes);
-	right = vector->spl_right;
-	vector->spl_nright = 0;
+	PG_RETURN_POINTER(result);
+}
 
-	mtree_float_array* entries[maxOffset];
+Datum mtree_float_array_from_float8(PG_FUNCTION_ARGS)
+{
+	ArrayType* array = PG_GETARG_ARRAYTYPE_P(0);
+	int arrayLength = mtree_native_array_length(array);
+	const float8* elements = (const float8*)ARR_DATA_PTR(array);
+	mtree_float_array* result = mtree_float_array_allocate(arrayLength);
 
-	for (OffsetNumber i = FirstOffsetNumber; i <= maxOffset; i = OffsetNumberNext(i)) {
-		entries[i - FirstOffsetNumber] = DatumGetMtreeFloatArray(entryVector->vector[i].key);
+	for (int i = 0; i < arrayLength; ++i) {
+		result->data[i] = mtree_float_array_coordinate(elements[i]);
 	}
+	result->parentDistance = mtree_float_array_reference_distance(result);
 
-	double distances[maxOffset][maxOffset];
-	init_distances(maxOffset, *distances);
-
-	int leftIndex, rightIndex, leftCandidateIndex, rightCandidateIndex;
-	int trialCount = 100;
-	double maxDistance = -1.0;
-	double minCoveringSum = -1.0;
-	double minCoveringMax = -1.0;
-	double minOverlapArea = -1.0;
-	double minSumArea = -1.0;
-
-	MtreePickSplitStrategy PICKSPLIT_STRATEGY_FLOAT_ARRAY = SamplingMinOverlapArea;
-	if (PG_HAS_OPCLASS_OPTIONS()) {
-		MtreeOptions* options = (MtreeOptions*)PG_GET_OPCLASS_OPTIONS();
-		PICKSPLIT_STRATEGY_FLOAT_ARRAY = options->picksplit_strategy;
-	}
+	PG_RETURN_POINTER(result);
+}
 
-	switch (PICKSPLIT_STRATEGY_FLOAT_ARRAY) {
-		case Random:
-			leftIndex = ((int)random()) % (maxOffset - 1);
-			rightIndex = (leftIndex + 1) + (((int)random()) % (maxOffset - leftIndex - 1));
-			break;
-		case FirstTwo:
-			leftIndex = -1;
-			rightIndex = -1;
-
-			for (int i = 0; i < maxOffset - 1; ++i) {
-				if (entries[i]->level == entries[i + 1]->level) {
-					leftIndex = i;
-					rightIndex = i + 1;
-					break;
-				}
-			}
-
-			break;
-		case MaxDistanceFromFirst:
-			maxDistance = -1.0;
-			for (int r = 0; r < maxOffset; ++r) {
-				double distance = get_float_array_distance(maxOffset, entries, distances, 0, r);
-				if (distance > maxDistance) {
-					maxDistance = distance;
-					rightCandidateIndex = r;
-				}
-			}
-			leftIndex = 0;
-			rightIndex = rightCandidateIndex;
-			break;
-		case MaxDistancePair:
-			for (OffsetNumber l = 0; l < maxOffset; ++l) {
-				for (OffsetNumber r = l; r < maxOffset; ++r) {
-					double distance = get_float_array_distance(maxOffset, entries, distances, l, r);
-					if (distance > maxDistance) {
-						maxDistance = distance;
-						leftCandidateIndex = l;
-						rightCandidateIndex = r;
-					}
-				}
-			}
-			leftIndex = leftCandidateIndex;
-			rightIndex = rightCandidateIndex;
-			break;
-		case SamplingMinCoveringSum:
-			for (int i = 0; i < trialCount; ++i) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; currentIndex++) {
-					double distanceLeft =
-						get_float_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_float_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				if (minCoveringSum == -1.0 || leftRadius + rightRadius < minCoveringSum) {
-					minCoveringSum = leftRadius + rightRadius;
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		case SamplingMinCoveringMax:
-			for (int i = 0; i < trialCount; ++i) {
-				leftCandidateIndex = (random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; ++currentIndex) {
-					double distanceLeft =
-						get_float_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_float_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				if (minCoveringMax == -1.0 || MAX_2(leftRadius, rightRadius) < minCoveringMax) {
-					minCoveringMax = MAX_2(leftRadius, rightRadius);
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		case SamplingMinOverlapArea:
-			for (int i = 0; i < trialCount; i++) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double distance =
-					get_float_array_distance(maxOffset, entries, distances, leftCandidateIndex, rightCandidateIndex);
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; currentIndex++) {
-					double distanceLeft =
-						get_float_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_float_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				double currentOverlapArea = overlap_area(leftRadius, rightRadius, distance);
-				if (minOverlapArea == -1.0 || currentOverlapArea < minOverlapArea) {
-					minOverlapArea = currentOverlapArea;
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		case GuttmanPolyTime:
-			for (int i = 0; i < maxOffset; i++) {
-				for (int j = i + 1; j < maxOffset; j++) {
-					leftCandidateIndex = i;
-					rightCandidateIndex = j;
-					double distance = get_float_array_distance(maxOffset, entries, distances, leftCandidateIndex,
-															   rightCandidateIndex);
-					double leftRadius = 0.0, rightRadius = 0.0;
-
-					for (int currentIndex = 0; currentIndex < maxOffset; currentIndex++) {
-						double distanceLeft =
-							get_float_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-						double distanceRight =
-							get_float_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-						if (distanceLeft < distanceRight) {
-							if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-								leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-							}
-						} else {
-							if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-								rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-							}
-						}
-					}
-
-					double currentOverlapArea = overlap_area(leftRadius, rightRadius, distance);
-					if ((minOverlapArea == -1.0 || currentOverlapArea < minOverlapArea) &&
-						(currentOverlapArea != 0.0)) {
-						minOverlapArea = currentOverlapArea;
-						leftIndex = leftCandidateIndex;
-						rightIndex = rightCandidateIndex;
-					}
-				}
-			}
-			break;
-		case SamplingMinAreaSum:
-			for (int i = 0; i < trialCount; i++) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; currentIndex++) {
-					double distanceLeft =
-						get_float_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_float_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				double currentSumArea = leftRadius * leftRadius + rightRadius * rightRadius;
-				if (minSumArea == -1.0 || currentSumArea < minSumArea) {
-					minSumArea = currentSumArea;
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
+/*
+ * Returns the cast of a native array type to mtree_float_array, or NULL.
+ */
+static PGFunction mtree_float_array_query_converter(Oid type)
+{
+	switch (type) {
+		case FLOAT4ARRAYOID:
+			return mtree_float_array_from_float4;
+		case FLOAT8ARRAYOID:
+			return mtree_float_array_from_float8;
 		default:
-			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-					errmsg("Invalid StrategyNumber for picksplit function: %u", PICKSPLIT_STRATEGY_FLOAT_ARRAY));
-			break;
+			return NULL;
 	}
+}
 
-	mtree_float_array* unionLeft = mtree_float_array_deep_copy(entries[leftIndex]);
-	mtree_float_array* unionRight = mtree_float_array_deep_copy(entries[rightIndex]);
-	mtree_float_array* current;
-
-	for (OffsetNumber i = FirstOffsetNumber; i <= maxOffset; i = OffsetNumberNext(i)) {
-		double distanceLeft = get_float_array_distance(maxOffset, entries, distances, leftIndex, i - 1);
-		double distanceRight = get_float_array_distance(maxOffset, entries, distances, rightIndex, i - 1);
-		current = entries[i - 1];
-
-		if (distanceLeft < distanceRight) {
-			if (distanceLeft + current->coveringRadius > unionLeft->coveringRadius) {
-				unionLeft->coveringRadius = distanceLeft + current->coveringRadius;
-			}
-			*left = i;
-			++left;
-			++(vector->spl_nleft);
-		} else {
-			if (distanceRight + current->coveringRadius > unionRight->coveringRadius) {
-				unionRight->coveringRadius = distanceRight + current->coveringRadius;
-			}
-			*right = i;
-			++right;
-			++(vector->spl_nright);
-		}
-	}
+#define MT_TYPE mtree_float_array
+#define MT_PREFIX mtree_float_array
+#define MT_VECTOR_ELEMENT(x) (float)(x)
+#define MT_QUERY_CONVERTER mtree_float_array_query_converter
+#define MT_DATUM_GET DatumGetMtreeFloatArray
+#define MT_STORE_PARENT_DISTANCE
+#define MT_PADDING padding
+#define MT_QUANTIZE
+#include "mtree_template.h"
+
+/*
+ * Both the = operator and the same support function of the operator class,
+ * which GiST calls with a third argument for its result.
+ */
+Datum mtree_float_array_same(PG_FUNCTION_ARGS)
+{
+	mtree_float_array* first = PG_GETARG_MTREE_FLOAT_ARRAY_P(0);
+	mtree_float_array* second = PG_GETARG_MTREE_FLOAT_ARRAY_P(1);
 
-	vector->spl_ldatum = PointerGetDatum(unionLeft);
-	vector->spl_rdatum = PointerGetDatum(unionRight);
+	if (PG_NARGS() > 2) {
+		bool* result = (bool*)PG_GETARG_POINTER(2);
+		*result = mtree_key_identical(first, second);
+		PG_RETURN_POINTER(result);
+	}
 
-	PG_RETURN_POINTER(vector);
+	PG_RETURN_BOOL(mtree_float_array_equals(first, second));
 }
 
-Datum mtree_float_array_compress(PG_FUNCTION_ARGS)
+/*
+ * The sorted build sorts stored keys.
+ */
+static double mtree_float_array_datum_distance(Datum first, Datum second)
 {
-	PG_RETURN_POINTER(PG_GETARG_POINTER(0));
-}
+	mtree_float_array* firstKey = mtree_float_array_expand_key(first);
+	mtree_float_array* secondKey = mtree_float_array_expand_key(second);
+	double distance = mtree_float_array_full_distance(firstKey, secondKey);
 
-Datum mtree_float_array_decompress(PG_FUNCTION_ARGS)
-{
-	PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	pfree(firstKey);
+	pfree(secondKey);
+
+	return distance;
 }
 
-Datum mtree_float_array_distance(PG_FUNCTION_ARGS)
+Datum mtree_float_array_sortsupport(PG_FUNCTION_ARGS)
 {
-	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
-	mtree_float_array* query = PG_GETARG_MTREE_FLOAT_ARRAY_P(1);
-	mtree_float_array* key = DatumGetMtreeFloatArray(entry->key);
+	SortSupport ssup = (SortSupport)PG_GETARG_POINTER(0);
 
-	PG_RETURN_FLOAT8((float8)mtree_float_array_outer_distance(query, key));
+	mtree_pivot_sortsupport(ssup, mtree_float_array_datum_distance);
+
+	PG_RETURN_VOID();
 }
 
 Datum mtree_float_array_distance_operator(PG_FUNCTION_ARGS)
@@ -571,6 +315,25 @@ Datum mtree_float_array_distance_operator(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8((float8)mtree_float_array_outer_distance(first, second));
 }
 
+/*
+ * Returns a copy of the object with the given covering radius, so that
+ * x #<# mtree_ball(q, r) is an indexed range query.
+ */
+Datum mtree_float_array_radius(PG_FUNCTION_ARGS)
+{
+	mtree_float_array* center = PG_GETARG_MTREE_FLOAT_ARRAY_P(0);
+	float8 radius = PG_GETARG_FLOAT8(1);
+
+	if (!(radius >= 0.0)) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("The radius can't be negative!"));
+	}
+
+	mtree_float_array* result = mtree_float_array_deep_copy(center);
+	result->coveringRadius = radius;
+
+	PG_RETURN_POINTER(result);
+}
+
 Datum mtree_float_array_overlap_operator(PG_FUNCTION_ARGS)
 {
 	mtree_float_array* first = PG_GETARG_MTREE_FLOAT_ARRAY_P(0);
@@ -597,3 +360,34 @@ Datum mtree_float_array_contained_operator(PG_FUNCTION_ARGS)
 
 	PG_RETURN_BOOL(result);
 }
+
+/*
+ * Cross-type operators with a float4[] or float8[] on the right.
+ */
+static mtree_float_array* mtree_float_array_native_argument(FunctionCallInfo fcinfo, int argument)
+{
+	PGFunction convert = mtree_float_array_query_converter(get_fn_expr_argtype(fcinfo->flinfo, argument));
+
+	if (convert == NULL) {
+		ereport(ERROR, errcode(ERRCODE_DATATYPE_MISMATCH), errmsg("The argument has to be a float4[] or float8[]!"));
+	}
+
+	return DatumGetMtreeFloatArray(DirectFunctionCall1(convert, PG_GETARG_DATUM(argument)));
+}
+
+Datum mtree_float_array_native_contains_operator(PG_FUNCTION_ARGS)
+{
+	mtree_float_array* first = PG_GETARG_MTREE_FLOAT_ARRAY_P(0);
+	mtree_float_array* second = mtree_float_array_native_argument(fcinfo, 1);
+	bool result = mtree_float_array_contains_distance(first, second);
+
+	PG_RETURN_BOOL(result);
+}
+
+Datum mtree_float_array_native_distance_operator(PG_FUNCTION_ARGS)
+{
+	mtree_float_array* first = PG_GETARG_MTREE_FLOAT_ARRAY_P(0);
+	mtree_float_array* second = mtree_float_array_native_argument(fcinfo, 1);
+
+	PG_RETURN_FLOAT8((float8)mtree_float_array_outer_distance(first, second));
+}
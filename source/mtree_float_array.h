@@ -17,11 +17,17 @@
 #define PG_RETURN_MTREE_FLOAT_ARRAY_P(x) PG_RETURN_POINTER(x)
 
 typedef struct {
+	/* varlena header (do not touch directly!) */
+	int32 vl_len_;
+	int level;
 	double parentDistance;
 	double coveringRadius;
-	unsigned char arrayLength;
-	int level;
+	int32 arrayLength;
+	/* data starts MTREE_PAYLOAD_ALIGNMENT bytes into the key */
+	char padding[4];
 	float data[FLEXIBLE_ARRAY_MEMBER];
-} __attribute__((packed, aligned(1))) mtree_float_array;
+} mtree_float_array;
+
+StaticAssertDecl(offsetof(mtree_float_array, data) % MTREE_PAYLOAD_ALIGNMENT == 0, "misaligned mtree_float_array data");
 
 #endif
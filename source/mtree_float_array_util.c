@@ -6,30 +6,13 @@
 
 #include <math.h>
 
-double mtree_float_array_outer_distance(mtree_float_array* first, mtree_float_array* second)
-{
-	double distance = float_array_euclidean_distance(first, second);
-	double outer_distance = distance - first->coveringRadius - second->coveringRadius;
-
-	if (outer_distance < 0.0) {
-		outer_distance = 0.0;
-	}
-
-	return outer_distance;
-}
-
-double mtree_float_array_full_distance(mtree_float_array* first, mtree_float_array* second)
-{
-	return float_array_euclidean_distance(first, second);
-}
-
 bool mtree_float_array_equals(mtree_float_array* first, mtree_float_array* second)
 {
 	if (first->arrayLength != second->arrayLength) {
 		return false;
 	}
 
-	for (unsigned char i = 0; i < first->arrayLength; ++i) {
+	for (int i = 0; i < first->arrayLength; ++i) {
 		if (first->data[i] != second->data[i]) {
 			return false;
 		}
@@ -62,18 +45,10 @@ mtree_float_array* mtree_float_array_deep_copy(mtree_float_array* source)
 	return destination;
 }
 
-double get_float_array_distance(int size, mtree_float_array* entries[size], double distances[size][size], int i, int j)
-{
-	if (distances[i][j] == -1) {
-		distances[i][j] = mtree_float_array_full_distance(entries[i], entries[j]);
-	}
-	return distances[i][j];
-}
-
 double float_array_sum_distance(mtree_float_array* first, mtree_float_array* second)
 {
 	double distance = 0.0;
-	unsigned char minimumLength, maximumLength;
+	int minimumLength, maximumLength;
 	mtree_float_array* longer;
 
 	if (first->arrayLength <= second->arrayLength) {
@@ -86,7 +61,7 @@ double float_array_sum_distance(mtree_float_array* first, mtree_float_array* sec
 		longer = first;
 	}
 
-	for (unsigned char i = 0; i < minimumLength; ++i) {
+	for (int i = 0; i < minimumLength; ++i) {
 		if (first->data[i] + second->data[i] != 0.0) {
 			distance += (((first->data[i] - second->data[i]) * (first->data[i] - second->data[i])) /
 						 (first->data[i] + second->data[i]));
@@ -95,7 +70,7 @@ double float_array_sum_distance(mtree_float_array* first, mtree_float_array* sec
 		}
 	}
 
-	for (unsigned char i = minimumLength; i < maximumLength; ++i) {
+	for (int i = minimumLength; i < maximumLength; ++i) {
 		distance += longer->data[i];
 	}
 
@@ -105,7 +80,7 @@ double float_array_sum_distance(mtree_float_array* first, mtree_float_array* sec
 double float_array_kullback_leibler_distance(mtree_float_array* first, mtree_float_array* second)
 {
 	double distance = 0.0;
-	unsigned char minimumLength, maximumLength;
+	int minimumLength, maximumLength;
 	mtree_float_array* longer;
 
 	if (first->arrayLength <= second->arrayLength) {
@@ -118,7 +93,7 @@ double float_array_kullback_leibler_distance(mtree_float_array* first, mtree_flo
 		longer = first;
 	}
 
-	for (unsigned char i = 0; i < minimumLength; ++i) {
+	for (int i = 0; i < minimumLength; ++i) {
 		if (second->data[i] != 0) {
 			distance += ((first->data[i] - second->data[i]) * log(first->data[i] / second->data[i]));
 		} else {
@@ -126,36 +101,10 @@ double float_array_kullback_leibler_distance(mtree_float_array* first, mtree_flo
 		}
 	}
 
-	for (unsigned char i = minimumLength; i < maximumLength; ++i) {
+	for (int i = minimumLength; i < maximumLength; ++i) {
 		distance += longer->data[i];
 	}
 
 	return distance;
 }
 
-double float_array_euclidean_distance(mtree_float_array* first, mtree_float_array* second)
-{
-	double distance = 0.0;
-	int minimumLength, maximumLength;
-	mtree_float_array* longer;
-
-	if (first->arrayLength <= second->arrayLength) {
-		minimumLength = first->arrayLength;
-		maximumLength = second->arrayLength;
-		longer = second;
-	} else {
-		minimumLength = second->arrayLength;
-		maximumLength = first->arrayLength;
-		longer = first;
-	}
-
-	for (int i = 0; i < minimumLength; ++i) {
-		distance += ((first->data[i] - second->data[i]) * (first->data[i] - second->data[i]));
-	}
-
-	for (int i = minimumLength; i < maximumLength; ++i) {
-		distance += longer->data[i] * longer->data[i];
-	}
-
-	return sqrt(distance);
-}
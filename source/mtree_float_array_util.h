@@ -6,19 +6,91 @@
 #define __MTREE_FLOAT_ARRAY_UTIL_H__
 
 #include "mtree_float_array.h"
+#include "mtree_util.h"
 
-double mtree_float_array_outer_distance(mtree_float_array* first, mtree_float_array* second);
-double mtree_float_array_full_distance(mtree_float_array* first, mtree_float_array* second);
 bool mtree_float_array_equals(mtree_float_array* first, mtree_float_array* second);
 bool mtree_float_array_overlap_distance(mtree_float_array* first, mtree_float_array* second);
 bool mtree_float_array_contains_distance(mtree_float_array* first, mtree_float_array* second);
 bool mtree_float_array_contained_distance(mtree_float_array* first, mtree_float_array* second);
 mtree_float_array* mtree_float_array_deep_copy(mtree_float_array* source);
-double get_float_array_distance(int size, mtree_float_array* entries[size], double distances[size][size], int i, int j);
 
 double float_array_sum_distance(mtree_float_array* first, mtree_float_array* second);
 double float_array_kullback_leibler_distance(mtree_float_array* first, mtree_float_array* second);
-double float_array_euclidean_distance(mtree_float_array* first, mtree_float_array* second);
 double float_array_taxicab_distance(mtree_float_array* first, mtree_float_array* second);
 
+static inline double float_array_euclidean_distance(mtree_float_array* first, mtree_float_array* second)
+{
+	double distance = 0.0;
+	int minimumLength, maximumLength;
+	mtree_float_array* longer;
+
+	if (first->arrayLength <= second->arrayLength) {
+		minimumLength = first->arrayLength;
+		maximumLength = second->arrayLength;
+		longer = second;
+	} else {
+		minimumLength = second->arrayLength;
+		maximumLength = first->arrayLength;
+		longer = first;
+	}
+
+	/* Independent partial sums let long vectors use every SIMD lane. */
+	double sums[MTREE_DISTANCE_LANES] = {0.0};
+	int i = 0;
+
+	for (; i + MTREE_DISTANCE_LANES <= minimumLength; i += MTREE_DISTANCE_LANES) {
+		for (int lane = 0; lane < MTREE_DISTANCE_LANES; ++lane) {
+			double difference = (double)first->data[i + lane] - (double)second->data[i + lane];
+			sums[lane] += difference * difference;
+		}
+	}
+	for (; i < minimumLength; ++i) {
+		double difference = (double)first->data[i] - (double)second->data[i];
+		distance += difference * difference;
+	}
+
+	for (i = minimumLength; i < maximumLength; ++i) {
+		distance += (double)longer->data[i] * longer->data[i];
+	}
+
+	for (int lane = 0; lane < MTREE_DISTANCE_LANES; ++lane) {
+		distance += sums[lane];
+	}
+
+	return sqrt(distance);
+}
+
+static inline double mtree_float_array_full_distance(mtree_float_array* first, mtree_float_array* second)
+{
+	return float_array_euclidean_distance(first, second);
+}
+
+static inline double mtree_float_array_outer_distance(mtree_float_array* first, mtree_float_array* second)
+{
+	double distance = float_array_euclidean_distance(first, second);
+	double outer_distance = distance - first->coveringRadius - second->coveringRadius;
+
+	if (outer_distance < 0.0) {
+		outer_distance = 0.0;
+	}
+
+	return outer_distance;
+}
+
+/*
+ * Distance from the reference object (the empty array, which the Euclidean
+ * distance treats as the zero vector), stored in parentDistance.
+ */
+static inline double mtree_float_array_reference_distance(mtree_float_array* key)
+{
+	double distance = 0.0;
+
+	for (int i = 0; i < key->arrayLength; ++i) {
+		double value = (double)(key->data[i]);
+		distance += value * value;
+	}
+
+	return sqrt(distance);
+}
+
 #endif
@@ -4,23 +4,6 @@
 
 #include "mtree_float_util.h"
 
-double mtree_float_outer_distance(mtree_float* first, mtree_float* second)
-{
-	double distance = fabs(first->data - second->data);
-	double outer_distance = distance - first->coveringRadius - second->coveringRadius;
-
-	if (outer_distance < 0.0) {
-		outer_distance = 0.0;
-	}
-
-	return outer_distance;
-}
-
-double mtree_float_full_distance(mtree_float* first, mtree_float* second)
-{
-	return fabs(first->data - second->data);
-}
-
 bool mtree_float_equals(mtree_float* first, mtree_float* second)
 {
 	return first->data == second->data;
@@ -50,10 +33,3 @@ mtree_float* mtree_float_deep_copy(mtree_float* source)
 	return destination;
 }
 
-double get_float_distance(int size, mtree_float* entries[size], double distances[size][size], int i, int j)
-{
-	if (distances[i][j] == -1) {
-		distances[i][j] = mtree_float_full_distance(entries[i], entries[j]);
-	}
-	return distances[i][j];
-}
@@ -6,14 +6,37 @@
 #define __MTREE_FLOAT_UTIL_H__
 
 #include "mtree_float.h"
+#include "mtree_util.h"
 
-double mtree_float_full_distance(mtree_float* first, mtree_float* second);
-double mtree_float_outer_distance(mtree_float* first, mtree_float* second);
 bool mtree_float_equals(mtree_float* first, mtree_float* second);
 bool mtree_float_overlap_distance(mtree_float* first, mtree_float* second);
 bool mtree_float_contains_distance(mtree_float* first, mtree_float* second);
 bool mtree_float_contained_distance(mtree_float* first, mtree_float* second);
 mtree_float* mtree_float_deep_copy(mtree_float* source);
-double get_float_distance(int size, mtree_float* entries[size], double distances[size][size], int i, int j);
+
+static inline double mtree_float_full_distance(mtree_float* first, mtree_float* second)
+{
+	return fabs(first->data - second->data);
+}
+
+static inline double mtree_float_outer_distance(mtree_float* first, mtree_float* second)
+{
+	double distance = fabs(first->data - second->data);
+	double outer_distance = distance - first->coveringRadius - second->coveringRadius;
+
+	if (outer_distance < 0.0) {
+		outer_distance = 0.0;
+	}
+
+	return outer_distance;
+}
+
+/*
+ * Distance from the reference object (zero), stored in parentDistance.
+ */
+static inline double mtree_float_reference_distance(mtree_float* key)
+{
+	return fabs(key->data);
+}
 
 #endif
@@ -0,0 +1,575 @@
+/* contrib/mtree_gist/mtree_gist--1.0--1.1.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION mtree_gist UPDATE TO '1.1'" to load this file. \quit
+
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+-- Support functions
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+
+-- Version 1.1 stores mtree_text keys in the compact form too, fetches leaf
+-- keys for index-only scans and sorts the entries of a sorted build. The
+-- support functions are added before the columns are rewritten, so the
+-- rebuilt indexes use them.
+
+CREATE FUNCTION mtree_text_compress(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_text_decompress(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_text_fetch(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_text_sortsupport(internal)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER OPERATOR FAMILY gist_mtree_text_ops USING gist ADD
+	FUNCTION	3	(mtree_text, mtree_text)	mtree_text_compress	(internal),
+	FUNCTION	4	(mtree_text, mtree_text)	mtree_text_decompress	(internal),
+	FUNCTION	9	(mtree_text, mtree_text)	mtree_text_fetch	(internal),
+	FUNCTION	11	(mtree_text, mtree_text)	mtree_text_sortsupport	(internal);
+
+CREATE FUNCTION mtree_text_array_fetch(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_text_array_sortsupport(internal)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER OPERATOR FAMILY gist_mtree_text_array_ops USING gist ADD
+	FUNCTION	9	(mtree_text_array, mtree_text_array)	mtree_text_array_fetch	(internal),
+	FUNCTION	11	(mtree_text_array, mtree_text_array)	mtree_text_array_sortsupport	(internal);
+
+CREATE FUNCTION mtree_int32_fetch(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_int32_sortsupport(internal)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER OPERATOR FAMILY gist_mtree_int32_ops USING gist ADD
+	FUNCTION	9	(mtree_int32, mtree_int32)	mtree_int32_fetch	(internal),
+	FUNCTION	11	(mtree_int32, mtree_int32)	mtree_int32_sortsupport	(internal);
+
+CREATE FUNCTION mtree_int32_array_fetch(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_int32_array_sortsupport(internal)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER OPERATOR FAMILY gist_mtree_int32_array_ops USING gist ADD
+	FUNCTION	9	(mtree_int32_array, mtree_int32_array)	mtree_int32_array_fetch	(internal),
+	FUNCTION	11	(mtree_int32_array, mtree_int32_array)	mtree_int32_array_sortsupport	(internal);
+
+CREATE FUNCTION mtree_float_fetch(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_float_sortsupport(internal)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER OPERATOR FAMILY gist_mtree_float_ops USING gist ADD
+	FUNCTION	9	(mtree_float, mtree_float)	mtree_float_fetch	(internal),
+	FUNCTION	11	(mtree_float, mtree_float)	mtree_float_sortsupport	(internal);
+
+CREATE FUNCTION mtree_float_array_fetch(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_float_array_sortsupport(internal)
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER OPERATOR FAMILY gist_mtree_float_array_ops USING gist ADD
+	FUNCTION	9	(mtree_float_array, mtree_float_array)	mtree_float_array_fetch	(internal),
+	FUNCTION	11	(mtree_float_array, mtree_float_array)	mtree_float_array_sortsupport	(internal);
+
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+-- Strategy numbers
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+
+-- The operators use the strategy numbers of the built-in geometric operator
+-- classes: 3 for overlap, 6 for same, 7 for contains and 8 for contained by.
+
+ALTER OPERATOR FAMILY gist_mtree_text_array_ops USING gist DROP
+	OPERATOR	3	(mtree_text_array, mtree_text_array),
+	OPERATOR	6	(mtree_text_array, mtree_text_array);
+
+ALTER OPERATOR FAMILY gist_mtree_text_array_ops USING gist ADD
+	OPERATOR	3	#&#	(mtree_text_array, mtree_text_array),
+	OPERATOR	6	=	(mtree_text_array, mtree_text_array);
+
+ALTER OPERATOR FAMILY gist_mtree_int32_ops USING gist DROP
+	OPERATOR	1	(mtree_int32, mtree_int32),
+	OPERATOR	2	(mtree_int32, mtree_int32),
+	OPERATOR	3	(mtree_int32, mtree_int32),
+	OPERATOR	4	(mtree_int32, mtree_int32);
+
+ALTER OPERATOR FAMILY gist_mtree_int32_ops USING gist ADD
+	OPERATOR	3	#&#	(mtree_int32, mtree_int32),
+	OPERATOR	6	=	(mtree_int32, mtree_int32),
+	OPERATOR	7	#>#	(mtree_int32, mtree_int32),
+	OPERATOR	8	#<#	(mtree_int32, mtree_int32);
+
+ALTER OPERATOR FAMILY gist_mtree_int32_array_ops USING gist DROP
+	OPERATOR	1	(mtree_int32_array, mtree_int32_array),
+	OPERATOR	2	(mtree_int32_array, mtree_int32_array),
+	OPERATOR	3	(mtree_int32_array, mtree_int32_array),
+	OPERATOR	4	(mtree_int32_array, mtree_int32_array);
+
+ALTER OPERATOR FAMILY gist_mtree_int32_array_ops USING gist ADD
+	OPERATOR	3	#&#	(mtree_int32_array, mtree_int32_array),
+	OPERATOR	6	=	(mtree_int32_array, mtree_int32_array),
+	OPERATOR	7	#>#	(mtree_int32_array, mtree_int32_array),
+	OPERATOR	8	#<#	(mtree_int32_array, mtree_int32_array);
+
+ALTER OPERATOR FAMILY gist_mtree_float_ops USING gist DROP
+	OPERATOR	1	(mtree_float, mtree_float),
+	OPERATOR	2	(mtree_float, mtree_float),
+	OPERATOR	3	(mtree_float, mtree_float),
+	OPERATOR	4	(mtree_float, mtree_float);
+
+ALTER OPERATOR FAMILY gist_mtree_float_ops USING gist ADD
+	OPERATOR	3	#&#	(mtree_float, mtree_float),
+	OPERATOR	6	=	(mtree_float, mtree_float),
+	OPERATOR	7	#>#	(mtree_float, mtree_float),
+	OPERATOR	8	#<#	(mtree_float, mtree_float);
+
+ALTER OPERATOR FAMILY gist_mtree_float_array_ops USING gist DROP
+	OPERATOR	1	(mtree_float_array, mtree_float_array),
+	OPERATOR	2	(mtree_float_array, mtree_float_array),
+	OPERATOR	3	(mtree_float_array, mtree_float_array),
+	OPERATOR	4	(mtree_float_array, mtree_float_array);
+
+ALTER OPERATOR FAMILY gist_mtree_float_array_ops USING gist ADD
+	OPERATOR	3	#&#	(mtree_float_array, mtree_float_array),
+	OPERATOR	6	=	(mtree_float_array, mtree_float_array),
+	OPERATOR	7	#>#	(mtree_float_array, mtree_float_array),
+	OPERATOR	8	#<#	(mtree_float_array, mtree_float_array);
+
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+-- Range queries
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+
+-- mtree_ball(value, radius) is the ball queried by #<#, #># and #&#.
+
+CREATE FUNCTION mtree_ball(mtree_text, float8)
+RETURNS mtree_text
+AS 'MODULE_PATHNAME', 'mtree_text_radius'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_ball(mtree_text_array, float8)
+RETURNS mtree_text_array
+AS 'MODULE_PATHNAME', 'mtree_text_array_radius'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_ball(mtree_int32, float8)
+RETURNS mtree_int32
+AS 'MODULE_PATHNAME', 'mtree_int32_radius'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_ball(mtree_int32_array, float8)
+RETURNS mtree_int32_array
+AS 'MODULE_PATHNAME', 'mtree_int32_array_radius'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_ball(mtree_float, float8)
+RETURNS mtree_float
+AS 'MODULE_PATHNAME', 'mtree_float_radius'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_ball(mtree_float_array, float8)
+RETURNS mtree_float_array
+AS 'MODULE_PATHNAME', 'mtree_float_array_radius'
+LANGUAGE C STRICT IMMUTABLE;
+
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+-- Bulk loading
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+
+-- Creates an M-tree index on a single column of a populated table with the
+-- sorted GiST build, which packs the index bottom-up in the order given by
+-- the sortsupport of the operator class (see mtree_gist.build_seeds). With
+-- pivots > 0, that many random values of the column become the pivots of the
+-- index (see the pivots operator class option).
+
+CREATE FUNCTION mtree_bulk_build(index_name name, relation regclass, column_name name, options text DEFAULT NULL, seeds integer DEFAULT NULL, pivots integer DEFAULT 0)
+RETURNS void
+AS $$
+DECLARE
+	column_type name;
+	pivot_values text;
+BEGIN
+	SELECT t.typname INTO column_type
+	FROM pg_attribute a JOIN pg_type t ON t.oid = a.atttypid
+	WHERE a.attrelid = relation AND a.attname = column_name AND a.attnum > 0 AND NOT a.attisdropped;
+
+	IF column_type IS NULL THEN
+		RAISE EXCEPTION 'column "%" of relation % does not exist', column_name, relation;
+	END IF;
+
+	IF column_type NOT IN ('mtree_text', 'mtree_text_array', 'mtree_int32', 'mtree_int32_array', 'mtree_float', 'mtree_float_array') THEN
+		RAISE EXCEPTION 'column "%" of type % is not an M-tree type', column_name, column_type;
+	END IF;
+
+	IF options IS NOT NULL AND options !~ '^[A-Za-z0-9_=,.\s]*$' THEN
+		RAISE EXCEPTION 'invalid operator class options "%"', options;
+	END IF;
+
+	IF seeds IS NOT NULL THEN
+		PERFORM set_config('mtree_gist.build_seeds', seeds::text, true);
+	END IF;
+
+	IF pivots > 0 THEN
+		EXECUTE format('SELECT string_agg(v, '';'') FROM (SELECT %I::text AS v FROM %s WHERE %I IS NOT NULL AND strpos(%I::text, '';'') = 0 ORDER BY random() LIMIT %s) p',
+			column_name, relation, column_name, column_name, pivots)
+		INTO pivot_values;
+
+		IF pivot_values IS NOT NULL THEN
+			options := concat_ws(', ', NULLIF(options, ''), 'pivots = ' || quote_literal(pivot_values));
+		END IF;
+	END IF;
+
+	EXECUTE format('CREATE INDEX %I ON %s USING gist (%I %I%s) WITH (buffering = off)',
+		index_name, relation, column_name, 'gist_' || column_type || '_ops',
+		CASE WHEN options IS NULL OR options = '' THEN '' ELSE '(' || options || ')' END);
+END;
+$$
+LANGUAGE plpgsql VOLATILE;
+
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+-- Aligned layouts
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+
+-- Version 1.1 lays the types out with their header fields first and the array
+-- payloads aligned, and stores index keys in a compact form. Every column of
+-- an M-tree type is rewritten from the 1.0 layout, which also rebuilds its
+-- indexes. Materialized views have to be refreshed afterwards.
+
+CREATE FUNCTION mtree_text_upgrade(mtree_text)
+RETURNS mtree_text
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_text_array_upgrade(mtree_text_array)
+RETURNS mtree_text_array
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_int32_upgrade(mtree_int32)
+RETURNS mtree_int32
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_int32_array_upgrade(mtree_int32_array)
+RETURNS mtree_int32_array
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_float_upgrade(mtree_float)
+RETURNS mtree_float
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_float_array_upgrade(mtree_float_array)
+RETURNS mtree_float_array
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+DO $$
+DECLARE
+	upgraded record;
+BEGIN
+	-- Inherited columns are rewritten through their topmost table.
+	FOR upgraded IN
+		SELECT a.attrelid::regclass AS relation, a.attname AS column_name, t.typname AS column_type, c.relkind
+		FROM pg_attribute a
+		JOIN pg_type t ON t.oid = a.atttypid
+		JOIN pg_class c ON c.oid = a.attrelid
+		WHERE t.typname IN ('mtree_text', 'mtree_text_array', 'mtree_int32', 'mtree_int32_array', 'mtree_float', 'mtree_float_array')
+			AND t.oid = to_regtype(t.typname)
+			AND c.relkind IN ('r', 'p', 'm')
+			AND a.attnum > 0 AND NOT a.attisdropped AND a.attinhcount = 0
+	LOOP
+		IF upgraded.relkind = 'm' THEN
+			RAISE WARNING 'materialized view % has to be refreshed', upgraded.relation;
+			CONTINUE;
+		END IF;
+
+		EXECUTE format('ALTER TABLE %s ALTER COLUMN %I TYPE %I USING %I(%I)',
+			upgraded.relation, upgraded.column_name, upgraded.column_type,
+			upgraded.column_type || '_upgrade', upgraded.column_name);
+	END LOOP;
+END;
+$$;
+
+DROP FUNCTION mtree_text_upgrade(mtree_text);
+DROP FUNCTION mtree_text_array_upgrade(mtree_text_array);
+DROP FUNCTION mtree_int32_upgrade(mtree_int32);
+DROP FUNCTION mtree_int32_array_upgrade(mtree_int32_array);
+DROP FUNCTION mtree_float_upgrade(mtree_float);
+DROP FUNCTION mtree_float_array_upgrade(mtree_float_array);
+
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+-- Binary I/O
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+
+-- Binary send and receive functions, used by COPY ... (FORMAT binary) and by
+-- clients of the binary protocol.
+
+CREATE FUNCTION mtree_text_recv(internal)
+RETURNS mtree_text
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_text_send(mtree_text)
+RETURNS bytea
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER TYPE mtree_text SET (
+	RECEIVE	= mtree_text_recv,
+	SEND	= mtree_text_send
+);
+
+CREATE FUNCTION mtree_text_array_recv(internal)
+RETURNS mtree_text_array
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_text_array_send(mtree_text_array)
+RETURNS bytea
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER TYPE mtree_text_array SET (
+	RECEIVE	= mtree_text_array_recv,
+	SEND	= mtree_text_array_send
+);
+
+CREATE FUNCTION mtree_int32_recv(internal)
+RETURNS mtree_int32
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_int32_send(mtree_int32)
+RETURNS bytea
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER TYPE mtree_int32 SET (
+	RECEIVE	= mtree_int32_recv,
+	SEND	= mtree_int32_send
+);
+
+CREATE FUNCTION mtree_int32_array_recv(internal)
+RETURNS mtree_int32_array
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_int32_array_send(mtree_int32_array)
+RETURNS bytea
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER TYPE mtree_int32_array SET (
+	RECEIVE	= mtree_int32_array_recv,
+	SEND	= mtree_int32_array_send
+);
+
+CREATE FUNCTION mtree_float_recv(internal)
+RETURNS mtree_float
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_float_send(mtree_float)
+RETURNS bytea
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER TYPE mtree_float SET (
+	RECEIVE	= mtree_float_recv,
+	SEND	= mtree_float_send
+);
+
+CREATE FUNCTION mtree_float_array_recv(internal)
+RETURNS mtree_float_array
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_float_array_send(mtree_float_array)
+RETURNS bytea
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT IMMUTABLE;
+
+ALTER TYPE mtree_float_array SET (
+	RECEIVE	= mtree_float_array_recv,
+	SEND	= mtree_float_array_send
+);
+
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+-- Native arrays
+-- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- -- --
+
+-- Casts from the native arrays to the array types, and cross-type operators
+-- taking a native array as the query. Index scans convert such a query once.
+
+CREATE FUNCTION mtree_float_array(float4[])
+RETURNS mtree_float_array
+AS 'MODULE_PATHNAME', 'mtree_float_array_from_float4'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE CAST (float4[] AS mtree_float_array)
+WITH FUNCTION mtree_float_array(float4[]) AS ASSIGNMENT;
+
+CREATE FUNCTION mtree_float_array_contains_operator(mtree_float_array, float4[])
+RETURNS bool
+AS 'MODULE_PATHNAME', 'mtree_float_array_native_contains_operator'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_float_array_distance_operator(mtree_float_array, float4[])
+RETURNS float8
+AS 'MODULE_PATHNAME', 'mtree_float_array_native_distance_operator'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OPERATOR #># (
+	LEFTARG		= mtree_float_array,
+	RIGHTARG	= float4[],
+	FUNCTION	= mtree_float_array_contains_operator
+);
+
+CREATE OPERATOR <-> (
+	LEFTARG		= mtree_float_array,
+	RIGHTARG	= float4[],
+	FUNCTION	= mtree_float_array_distance_operator
+);
+
+ALTER OPERATOR FAMILY gist_mtree_float_array_ops USING gist ADD
+	OPERATOR	7	#>#	(mtree_float_array, float4[]),
+	OPERATOR	15	<->	(mtree_float_array, float4[]) FOR ORDER BY float_ops;
+
+CREATE FUNCTION mtree_float_array(float8[])
+RETURNS mtree_float_array
+AS 'MODULE_PATHNAME', 'mtree_float_array_from_float8'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE CAST (float8[] AS mtree_float_array)
+WITH FUNCTION mtree_float_array(float8[]) AS ASSIGNMENT;
+
+CREATE FUNCTION mtree_float_array_contains_operator(mtree_float_array, float8[])
+RETURNS bool
+AS 'MODULE_PATHNAME', 'mtree_float_array_native_contains_operator'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_float_array_distance_operator(mtree_float_array, float8[])
+RETURNS float8
+AS 'MODULE_PATHNAME', 'mtree_float_array_native_distance_operator'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OPERATOR #># (
+	LEFTARG		= mtree_float_array,
+	RIGHTARG	= float8[],
+	FUNCTION	= mtree_float_array_contains_operator
+);
+
+CREATE OPERATOR <-> (
+	LEFTARG		= mtree_float_array,
+	RIGHTARG	= float8[],
+	FUNCTION	= mtree_float_array_distance_operator
+);
+
+ALTER OPERATOR FAMILY gist_mtree_float_array_ops USING gist ADD
+	OPERATOR	7	#>#	(mtree_float_array, float8[]),
+	OPERATOR	15	<->	(mtree_float_array, float8[]) FOR ORDER BY float_ops;
+
+CREATE FUNCTION mtree_int32_array(int4[])
+RETURNS mtree_int32_array
+AS 'MODULE_PATHNAME', 'mtree_int32_array_from_int4'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE CAST (int4[] AS mtree_int32_array)
+WITH FUNCTION mtree_int32_array(int4[]) AS ASSIGNMENT;
+
+CREATE FUNCTION mtree_int32_array_contains_operator(mtree_int32_array, int4[])
+RETURNS bool
+AS 'MODULE_PATHNAME', 'mtree_int32_array_native_contains_operator'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_int32_array_distance_operator(mtree_int32_array, int4[])
+RETURNS float8
+AS 'MODULE_PATHNAME', 'mtree_int32_array_native_distance_operator'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OPERATOR #># (
+	LEFTARG		= mtree_int32_array,
+	RIGHTARG	= int4[],
+	FUNCTION	= mtree_int32_array_contains_operator
+);
+
+CREATE OPERATOR <-> (
+	LEFTARG		= mtree_int32_array,
+	RIGHTARG	= int4[],
+	FUNCTION	= mtree_int32_array_distance_operator
+);
+
+ALTER OPERATOR FAMILY gist_mtree_int32_array_ops USING gist ADD
+	OPERATOR	7	#>#	(mtree_int32_array, int4[]),
+	OPERATOR	15	<->	(mtree_int32_array, int4[]) FOR ORDER BY float_ops;
+
+CREATE FUNCTION mtree_text_array(text[])
+RETURNS mtree_text_array
+AS 'MODULE_PATHNAME', 'mtree_text_array_from_text'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE CAST (text[] AS mtree_text_array)
+WITH FUNCTION mtree_text_array(text[]) AS ASSIGNMENT;
+
+CREATE FUNCTION mtree_text_array_contains_operator(mtree_text_array, text[])
+RETURNS bool
+AS 'MODULE_PATHNAME', 'mtree_text_array_native_contains_operator'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION mtree_text_array_distance_operator(mtree_text_array, text[])
+RETURNS float8
+AS 'MODULE_PATHNAME', 'mtree_text_array_native_distance_operator'
+LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OPERATOR #># (
+	LEFTARG		= mtree_text_array,
+	RIGHTARG	= text[],
+	FUNCTION	= mtree_text_array_contains_operator
+);
+
+CREATE OPERATOR <-> (
+	LEFTARG		= mtree_text_array,
+	RIGHTARG	= text[],
+	FUNCTION	= mtree_text_array_distance_operator
+);
+
+ALTER OPERATOR FAMILY gist_mtree_text_array_ops USING gist ADD
+	OPERATOR	7	#>#	(mtree_text_array, text[]),
+	OPERATOR	15	<->	(mtree_text_array, text[]) FOR ORDER BY float_ops;
@@ -3,11 +3,16 @@
  */
 #include "mtree_gist.h"
 
+#include "mtree_sort.h"
+
 #include "postgres.h"
 #include "fmgr.h"
+#include "utils/guc.h"
 
 PG_MODULE_MAGIC;
 
+void _PG_init(void);
+
 PG_FUNCTION_INFO_V1(mtree_options);
 
 /*
@@ -25,6 +30,8 @@ relopt_enum_elt_def mtreePickSplitStrategyValues[] =
 	{"SamplingMinOverlapArea",	SamplingMinOverlapArea},
 	{"SamplingMinAreaSum",		SamplingMinAreaSum},
 	{"GuttmanPolyTime", 		GuttmanPolyTime},
+	{"MinMaxRadius",			MinMaxRadius},
+	{"MaxLowerBoundDistance",	MaxLowerBoundDistance},
 	{(const char*) NULL}
 };
 
@@ -36,9 +43,64 @@ relopt_enum_elt_def mtreeUnionStrategyValues[] =
 {
 	{"First",			First},
 	{"MinMaxDistance",	MinMaxDistance},
+	{"MinimumEnclosingBall",	MinimumEnclosingBall},
 	{(const char *) NULL}
 };
 
+void _PG_init(void)
+{
+	DefineCustomIntVariable(
+		"mtree_gist.build_seeds",
+		"Number of seed objects per level of the sorted M-tree index build.",
+		"Zero orders the keys by their distance from a single pivot.",
+		&mtree_build_seeds,
+		MTREE_DEFAULT_BUILD_SEEDS,
+		0,
+		MTREE_MAX_BUILD_SEEDS,
+		PGC_USERSET,
+		0,
+		NULL,
+		NULL,
+		NULL);
+
+	MarkGUCPrefixReserved("mtree_gist");
+}
+
+/*
+ * String representation of MtreeDistribution values for
+ * operator class option support.
+ */
+relopt_enum_elt_def mtreeDistributionValues[] =
+{
+	{"GeneralizedHyperplane",	GeneralizedHyperplane},
+	{"Balanced",				Balanced},
+	{(const char *) NULL}
+};
+
+/*
+ * Checks the number of pivot objects. Their format is checked by the input
+ * function of the type when the index is built.
+ */
+static void mtree_validate_pivots(const char* value)
+{
+	if (value == NULL) {
+		return;
+	}
+
+	int count = 1;
+	for (const char* c = value; *c != '\0'; ++c) {
+		if (*c == MTREE_PIVOT_SEPARATOR) {
+			++count;
+		}
+	}
+
+	if (count > MTREE_MAX_PIVOTS) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("At most %d pivots can be given, separated by \"%c\"!", MTREE_MAX_PIVOTS,
+					   MTREE_PIVOT_SEPARATOR));
+	}
+}
+
 Datum mtree_options(PG_FUNCTION_ARGS)
 {
 	local_relopts *relopts = (local_relopts *) PG_GETARG_POINTER(0);
@@ -51,7 +113,7 @@ Datum mtree_options(PG_FUNCTION_ARGS)
 		"PickSplit strategies for the M-tree index implementation",
 		mtreePickSplitStrategyValues,
 		SamplingMinOverlapArea,
-		"Valid values are: \"Random\", \"FirstTwo\", \"MaxDistanceFromFirst\", \"MaxDistancePair\", \"SamplingMinCoveringSum\", \"SamplingMinCoveringMax\", \"SamplingMinOverlapArea\" and \"SamplingMinAreaSum\".",
+		"Valid values are: \"Random\", \"FirstTwo\", \"MaxDistanceFromFirst\", \"MaxDistancePair\", \"SamplingMinCoveringSum\", \"SamplingMinCoveringMax\", \"SamplingMinOverlapArea\", \"SamplingMinAreaSum\", \"GuttmanPolyTime\", \"MinMaxRadius\" and \"MaxLowerBoundDistance\".",
 		offsetof(MtreeOptions, picksplit_strategy));
 
 	add_local_enum_reloption(
@@ -60,8 +122,78 @@ Datum mtree_options(PG_FUNCTION_ARGS)
 		"Union strategies for the M-tree index implementation",
 		mtreeUnionStrategyValues,
 		MinMaxDistance,
-		"Valid values are: \"First\" and \"MinMaxDistance\".",
+		"Valid values are: \"First\", \"MinMaxDistance\" and \"MinimumEnclosingBall\".",
 		offsetof(MtreeOptions, union_strategy));
 
+	add_local_enum_reloption(
+		relopts,
+		"distribution",
+		"Distribution of the entries between the nodes of a split",
+		mtreeDistributionValues,
+		GeneralizedHyperplane,
+		"Valid values are: \"GeneralizedHyperplane\" and \"Balanced\".",
+		offsetof(MtreeOptions, distribution));
+
+	add_local_int_reloption(
+		relopts,
+		"sampling_trials",
+		"Maximum number of candidate pairs tried by the sampling PickSplit strategies",
+		MTREE_DEFAULT_SAMPLING_TRIALS,
+		1,
+		1000000,
+		offsetof(MtreeOptions, sampling_trials));
+
+	add_local_int_reloption(
+		relopts,
+		"sampling_patience",
+		"Number of trials without improvement after which sampling stops, 0 disables it",
+		0,
+		0,
+		1000000,
+		offsetof(MtreeOptions, sampling_patience));
+
+	add_local_int_reloption(
+		relopts,
+		"random_seed",
+		"Seed of the random generator used by the PickSplit strategies",
+		0,
+		0,
+		INT_MAX,
+		offsetof(MtreeOptions, random_seed));
+
+	add_local_string_reloption(
+		relopts,
+		"pivots",
+		"Pivot objects of the PM-tree rings, separated by semicolons",
+		NULL,
+		mtree_validate_pivots,
+		NULL,
+		offsetof(MtreeOptions, pivots));
+
+	add_local_bool_reloption(
+		relopts,
+		"quantize",
+		"Store the centers of internal keys in 8 bits per coordinate (mtree_float_array only)",
+		false,
+		offsetof(MtreeOptions, quantize));
+
+	add_local_int_reloption(
+		relopts,
+		"sketch_projections",
+		"Number of random projections kept with the keys to reject them early (vector types only)",
+		0,
+		0,
+		MTREE_MAX_SKETCH_PROJECTIONS,
+		offsetof(MtreeOptions, sketch_projections));
+
+	add_local_int_reloption(
+		relopts,
+		"sketch_dimensions",
+		"Number of leading coordinates covered by the random projections, usually the dimension of the vectors",
+		0,
+		0,
+		MTREE_MAX_SKETCH_DIMENSIONS,
+		offsetof(MtreeOptions, sketch_dimensions));
+
 	PG_RETURN_VOID();
 }
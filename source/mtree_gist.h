@@ -15,7 +15,12 @@ typedef enum {
 	/* Choose the first entry. */
 	First,
 	/* Choose the entry with the minimal maximum distance from the others. */
-	MinMaxDistance
+	MinMaxDistance,
+	/*
+	 * Approximate the minimum enclosing ball with a synthetic center (vector
+	 * types only, the others use MinMaxDistance).
+	 */
+	MinimumEnclosingBall
 } MtreeUnionStrategy;
 
 /*
@@ -39,9 +44,23 @@ typedef enum {
 	/*  */
 	SamplingMinAreaSum,
 	/* */
-	GuttmanPolyTime
+	GuttmanPolyTime,
+	/* Try every pair and minimize the larger radius (mM_RAD). */
+	MinMaxRadius,
+	/* Choose the pair farthest apart by their parent distances (M_LB_DIST). */
+	MaxLowerBoundDistance
 } MtreePickSplitStrategy;
 
+/*
+ * Distributions of the entries between the two nodes of a split
+ */
+typedef enum {
+	/* Assign every entry to the nearer routing entry. */
+	GeneralizedHyperplane,
+	/* Alternately assign the nearest remaining entry to each routing entry. */
+	Balanced
+} MtreeDistribution;
+
 /*
  * Operator class options
  */
@@ -52,8 +71,45 @@ typedef struct {
 	MtreePickSplitStrategy picksplit_strategy;
 	/* Union strategy */
 	MtreeUnionStrategy union_strategy;
+	/* Distribution of the entries in PickSplit */
+	MtreeDistribution distribution;
+	/* Maximum number of pairs tried by the sampling PickSplit strategies */
+	int sampling_trials;
+	/* Stop sampling after this many trials without improvement (0 = never) */
+	int sampling_patience;
+	/* Seed of the random generator of the PickSplit strategies */
+	int random_seed;
+	/* Pivot objects separated by semicolons (offset of the string) */
+	int pivots;
+	/* Store the centers of internal keys in 8 bits per coordinate */
+	bool quantize;
+	/* Number of random projections kept in the rings of the keys */
+	int sketch_projections;
+	/* Number of leading coordinates the projections cover */
+	int sketch_dimensions;
 } MtreeOptions;
 
+#define MTREE_DEFAULT_SAMPLING_TRIALS 100
+#define MTREE_ENCLOSING_BALL_ITERATIONS 64
+#define MTREE_LOWER_BOUND_TOLERANCE 1e-9
+#define MTREE_MAX_PIVOTS 16
+#define MTREE_MAX_SKETCH_PROJECTIONS 64
+#define MTREE_MAX_SKETCH_DIMENSIONS 65536
+#define MTREE_MAX_RINGS (MTREE_MAX_PIVOTS + MTREE_MAX_SKETCH_PROJECTIONS)
+#define MTREE_PIVOT_SEPARATOR ';'
+
+/*
+ * Offset of the array payload of the vector and text array keys from the
+ * start of the key. The header fields come first, in the same order in every
+ * type, without packing, so the distance loops read aligned elements.
+ */
+#define MTREE_PAYLOAD_ALIGNMENT 32
+
+/*
+ * Number of partial sums of the vector distance loops.
+ */
+#define MTREE_DISTANCE_LANES 8
+
 /*
  * GiST Strategy Numbers
  */
@@ -5,10 +5,18 @@
 #include "mtree_int32_array.h"
 
 #include "mtree_int32_array_util.h"
+#include "mtree_sort.h"
 #include "mtree_util.h"
+#include "catalog/pg_type.h"
+#include "libpq/pqformat.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
 
 PG_FUNCTION_INFO_V1(mtree_int32_array_input);
 PG_FUNCTION_INFO_V1(mtree_int32_array_output);
+PG_FUNCTION_INFO_V1(mtree_int32_array_recv);
+PG_FUNCTION_INFO_V1(mtree_int32_array_send);
+PG_FUNCTION_INFO_V1(mtree_int32_array_from_int4);
 
 PG_FUNCTION_INFO_V1(mtree_int32_array_consistent);
 PG_FUNCTION_INFO_V1(mtree_int32_array_union);
@@ -16,9 +24,11 @@ PG_FUNCTION_INFO_V1(mtree_int32_array_same);
 
 PG_FUNCTION_INFO_V1(mtree_int32_array_penalty);
 PG_FUNCTION_INFO_V1(mtree_int32_array_picksplit);
+PG_FUNCTION_INFO_V1(mtree_int32_array_sortsupport);
 
 PG_FUNCTION_INFO_V1(mtree_int32_array_compress);
 PG_FUNCTION_INFO_V1(mtree_int32_array_decompress);
+PG_FUNCTION_INFO_V1(mtree_int32_array_fetch);
 
 PG_FUNCTION_INFO_V1(mtree_int32_array_distance);
 PG_FUNCTION_INFO_V1(mtree_int32_array_radius);
@@ -27,431 +37,215 @@ PG_FUNCTION_INFO_V1(mtree_int32_array_contains_operator);
 PG_FUNCTION_INFO_V1(mtree_int32_array_contained_operator);
 PG_FUNCTION_INFO_V1(mtree_int32_array_distance_operator);
 PG_FUNCTION_INFO_V1(mtree_int32_array_overlap_operator);
+PG_FUNCTION_INFO_V1(mtree_int32_array_native_contains_operator);
+PG_FUNCTION_INFO_V1(mtree_int32_array_native_distance_operator);
 
+/*
+ * Parses the comma separated integers in a single pass after counting them,
+ * without modifying the input.
+ */
 Datum mtree_int32_array_input(PG_FUNCTION_ARGS)
 {
-	char* input = PG_GETARG_CSTRING(0);
-	unsigned char inputLength = strlen(input);
+	const char* input = PG_GETARG_CSTRING(0);
+	const char* position = input;
 
-	if (inputLength == 0) {
+	if (*input == '\0') {
 		ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR), errmsg("The input is an empty string."));
 	}
 
-	char previousInteger = '\0';
-	unsigned char arrayLength = 1;
-	for (unsigned char i = 0; i < inputLength; ++i) {
-		if (isblank(input[i])) {
-			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR), errmsg("The array can not contain space or tab characters."));
-		} else if (input[i] == ',' && previousInteger != '\0') {
+	int arrayLength = 1;
+	for (const char* c = input; *c != '\0'; ++c) {
+		if (*c == ',') {
 			++arrayLength;
-			previousInteger = '\0';
-		} else if (input[i] == '0' && previousInteger == '\0' && (i + 1) < inputLength && isdigit(input[i + 1])) {
-			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR), errmsg("The integers can not contain leading zeros [0]."));
-		} else if (!isdigit(input[i]) && input[i] != '-') {
-			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-					errmsg("The array can only contain integers [0-9] and commas [,]."));
 		}
-		previousInteger = input[i];
 	}
 
-	size_t size = MTREE_INT32_ARRAY_SIZE + arrayLength * sizeof(long long) + 1;
-	mtree_int32_array* result = (mtree_int32_array*)palloc(size);
+	size_t size = MTREE_INT32_ARRAY_SIZE + arrayLength * sizeof(int);
+	mtree_int32_array* result = (mtree_int32_array*)palloc0(size);
+
+	for (int i = 0; i < arrayLength; ++i) {
+		char* end;
+
+		if (isspace((unsigned char)*position)) {
+			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR), errmsg("The array can not contain space or tab characters."));
+		}
+		if (position[0] == '0' && isdigit((unsigned char)position[1])) {
+			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR), errmsg("The integers can not contain leading zeros [0]."));
+		}
 
-	char* tmp;
-	char* arrayElement = strtok(input, ",");
-	for (unsigned char i = 0; i < arrayLength; ++i) {
-		result->data[i] = strtol(arrayElement, &tmp, 10);
-		arrayElement = strtok(NULL, ",");
+		errno = 0;
+		long value = strtol(position, &end, 10);
+		if (end == position || (*end != ',' && *end != '\0')) {
+			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
+					errmsg("The array can only contain integers [0-9] and commas [,]."));
+		}
+		if (errno == ERANGE || value < INT_MIN || value > INT_MAX) {
+			ereport(ERROR, errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+					errmsg("The array can only contain 32 bit integers."));
+		}
+		result->data[i] = (int)value;
+		position = end + 1;
 	}
 
 	result->coveringRadius = 0.0;
-	result->parentDistance = 0.0;
+	result->level = 0;
 	result->arrayLength = arrayLength;
+	result->parentDistance = mtree_int32_array_reference_distance(result);
 
 	SET_VARSIZE(result, size);
 
 	PG_RETURN_POINTER(result);
 }
 
+/*
+ * Writes the elements with pg_ltoa directly into the result buffer, which has
+ * room for the sign, 10 digits and a comma per element.
+ */
 Datum mtree_int32_array_output(PG_FUNCTION_ARGS)
 {
 	mtree_int32_array* output = PG_GETARG_MTREE_INT32_ARRAY_P(0);
 
-	unsigned char arrayLength = output->arrayLength;
+	int arrayLength = output->arrayLength;
 
 	StringInfoData stringInfo;
 	initStringInfo(&stringInfo);
+	enlargeStringInfo(&stringInfo, arrayLength * 12);
 
-	char tmp[512];
-	for (unsigned char i = 0; i < arrayLength; ++i) {
-		sprintf(tmp, "%d", output->data[i]);
-		appendStringInfoString(&stringInfo, tmp);
-		if (i != arrayLength - 1) {
-			appendStringInfoChar(&stringInfo, ',');
+	for (int i = 0; i < arrayLength; ++i) {
+		if (i > 0) {
+			stringInfo.data[stringInfo.len++] = ',';
 		}
+		stringInfo.len += pg_ltoa(output->data[i], stringInfo.data + stringInfo.len);
 	}
+	stringInfo.data[stringInfo.len] = '\0';
 
 	PG_RETURN_CSTRING(stringInfo.data);
 }
 
-Datum mtree_int32_array_consistent(PG_FUNCTION_ARGS)
+/*
+ * Binary format: the header of mtree_send_header, the number of elements and
+ * the elements as int4.
+ */
+Datum mtree_int32_array_recv(PG_FUNCTION_ARGS)
 {
-	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
-	mtree_int32_array* query = PG_GETARG_MTREE_INT32_ARRAY_P(1);
-	StrategyNumber strategyNumber = (StrategyNumber)PG_GETARG_UINT16(2);
-	bool* recheck = (bool*)PG_GETARG_POINTER(4);
-	mtree_int32_array* key = DatumGetMtreeInt32Array(entry->key);
-
-	*recheck = false;
-
-	bool returnValue;
-	if (GIST_LEAF(entry)) {
-		switch (strategyNumber) {
-			case GIST_SN_SAME:
-				returnValue = mtree_int32_array_equals(key, query);
-				break;
-			case GIST_SN_OVERLAPS:
-				returnValue = mtree_int32_array_overlap_distance(key, query);
-				break;
-			case GIST_SN_CONTAINS:
-				returnValue = mtree_int32_array_contains_distance(key, query);
-				break;
-			case GIST_SN_CONTAINED_BY:
-				returnValue = mtree_int32_array_contained_distance(key, query);
-				break;
-			default:
-				ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-						errmsg("Invalid StrategyNumber for consistent function: %u", strategyNumber));
-				break;
-		}
-	} else {
-		switch (strategyNumber) {
-			case GIST_SN_SAME:
-				returnValue = mtree_int32_array_contains_distance(key, query);
-				break;
-			case GIST_SN_OVERLAPS:
-				returnValue = mtree_int32_array_overlap_distance(key, query);
-				break;
-			case GIST_SN_CONTAINS:
-				returnValue = mtree_int32_array_contains_distance(key, query);
-				break;
-			case GIST_SN_CONTAINED_BY:
-				returnValue = mtree_int32_array_overlap_distance(key, query);
-				break;
-			default:
-				ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-						errmsg("Invalid StrategyNumber for consistent function: %u", strategyNumber));
-				break;
-		}
-	}
+	StringInfo buffer = (StringInfo)PG_GETARG_POINTER(0);
+	int level;
+	double coveringRadius;
 
-	PG_RETURN_BOOL(returnValue);
-}
+	mtree_receive_header(buffer, &level, &coveringRadius);
 
-Datum mtree_int32_array_union(PG_FUNCTION_ARGS)
-{
-	GistEntryVector* entryVector = (GistEntryVector*)PG_GETARG_POINTER(0);
-	GISTENTRY* entry = entryVector->vector;
-	int ranges = entryVector->n;
+	int arrayLength = mtree_receive_length(buffer, 1, (MaxAllocSize - MTREE_INT32_ARRAY_SIZE) / sizeof(int),
+										   sizeof(int32));
+	size_t size = MTREE_INT32_ARRAY_SIZE + arrayLength * sizeof(int);
+	mtree_int32_array* result = (mtree_int32_array*)palloc0(size);
 
-	mtree_int32_array* entries[ranges];
-	for (int i = 0; i < ranges; ++i) {
-		entries[i] = DatumGetMtreeInt32Array(entry[i].key);
+	for (int i = 0; i < arrayLength; ++i) {
+		result->data[i] = (int)pq_getmsgint(buffer, 4);
 	}
 
-	mtree_int32_array* out = mtree_int32_array_deep_copy(entries[0]);
-	out->coveringRadius += mtree_int32_array_outer_distance(entries[0], entries[1]);
+	result->level = level;
+	result->coveringRadius = coveringRadius;
+	result->arrayLength = arrayLength;
+	result->parentDistance = mtree_int32_array_reference_distance(result);
+
+	SET_VARSIZE(result, size);
 
-	PG_RETURN_MTREE_INT32_ARRAY_P(out);
+	PG_RETURN_POINTER(result);
 }
 
-Datum mtree_int32_array_same(PG_FUNCTION_ARGS)
+Datum mtree_int32_array_send(PG_FUNCTION_ARGS)
 {
-	mtree_int32_array* first = PG_GETARG_MTREE_INT32_ARRAY_P(0);
-	mtree_int32_array* second = PG_GETARG_MTREE_INT32_ARRAY_P(1);
-	PG_RETURN_BOOL(mtree_int32_array_equals(first, second));
+	mtree_int32_array* value = PG_GETARG_MTREE_INT32_ARRAY_P(0);
+	StringInfoData buffer;
+
+	pq_begintypsend(&buffer);
+	mtree_send_header(&buffer, value->level, value->coveringRadius);
+	pq_sendint32(&buffer, (uint32)value->arrayLength);
+	for (int i = 0; i < value->arrayLength; ++i) {
+		pq_sendint32(&buffer, (uint32)value->data[i]);
+	}
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buffer));
 }
 
-Datum mtree_int32_array_penalty(PG_FUNCTION_ARGS)
+/*
+ * Cast from int4[], copying the elements without going through the text
+ * representation.
+ */
+Datum mtree_int32_array_from_int4(PG_FUNCTION_ARGS)
 {
-	GISTENTRY* originalEntry = (GISTENTRY*)PG_GETARG_POINTER(0);
-	GISTENTRY* newEntry = (GISTENTRY*)PG_GETARG_POINTER(1);
-	float* penalty = (float*)PG_GETARG_POINTER(2);
-	mtree_int32_array* original = DatumGetMtreeInt32Array(originalEntry->key);
-	mtree_int32_array* new = DatumGetMtreeInt32Array(newEntry->key);
+	ArrayType* array = PG_GETARG_ARRAYTYPE_P(0);
+	int arrayLength = mtree_native_array_length(array);
+	size_t size = MTREE_INT32_ARRAY_SIZE + arrayLength * sizeof(int);
+	mtree_int32_array* result = (mtree_int32_array*)palloc0(size);
+
+	memcpy(result->data, ARR_DATA_PTR(array), arrayLength * sizeof(int32));
+
+	result->arrayLength = arrayLength;
+	result->parentDistance = mtree_int32_array_reference_distance(result);
 
-	double distance = mtree_int32_array_outer_distance(original, new);
-	*penalty = distance;
+	SET_VARSIZE(result, size);
 
-	PG_RETURN_POINTER(penalty);
+	PG_RETURN_POINTER(result);
 }
 
-Datum mtree_int32_array_picksplit(PG_FUNCTION_ARGS)
+/*
+ * Returns the cast of a native array type to mtree_int32_array, or NULL.
+ */
+static PGFunction mtree_int32_array_query_converter(Oid type)
 {
-	GistEntryVector* entryVector = (GistEntryVector*)PG_GETARG_POINTER(0);
-	GIST_SPLITVEC* vector = (GIST_SPLITVEC*)PG_GETARG_POINTER(1);
-	OffsetNumber maxOffset = (OffsetNumber)entryVector->n - 1;
-	OffsetNumber numberBytes = (OffsetNumber)(maxOffset + 1) * sizeof(OffsetNumber);
-	OffsetNumber* left;
-	OffsetNumber* right;
-
-	vector->spl_left = (OffsetNumber*)palloc(numberBytes);
-	left = vector->spl_left;
-	vector->spl_nleft = 0;
-
-	vector->spl_right = (OffsetNumber*)palloc(numberBytes);
-	right = vector->spl_right;
-	vector->spl_nright = 0;
-
-	mtree_int32_array* entries[maxOffset];
-	for (OffsetNumber i = FirstOffsetNumber; i <= maxOffset; i = OffsetNumberNext(i)) {
-		entries[i - FirstOffsetNumber] = DatumGetMtreeInt32Array(entryVector->vector[i].key);
-	}
+	return type == INT4ARRAYOID ? mtree_int32_array_from_int4 : NULL;
+}
 
-	double distances[maxOffset][maxOffset];
-	init_distances(maxOffset, *distances);
-
-	int leftIndex, rightIndex, leftCandidateIndex, rightCandidateIndex;
-	int trialCount = 100;
-	double maxDistance = -1.0;
-	double minCoveringSum = -1.0;
-	double minCoveringMax = -1.0;
-	double minOverlapArea = -1.0;
-	double minSumArea = -1.0;
-
-	MtreePickSplitStrategy PICKSPLIT_STRATEGY_INT32_ARRAY = SamplingMinOverlapArea;
-	if (PG_HAS_OPCLASS_OPTIONS()) {
-		MtreeOptions* options = (MtreeOptions*)PG_GET_OPCLASS_OPTIONS();
-		PICKSPLIT_STRATEGY_INT32_ARRAY = options->picksplit_strategy;
-	}
+#define MT_TYPE mtree_int32_array
+#define MT_PREFIX mtree_int32_array
+#define MT_VECTOR_ELEMENT(x) (int)rint(x)
+#define MT_QUERY_CONVERTER mtree_int32_array_query_converter
+#define MT_DATUM_GET DatumGetMtreeInt32Array
+#define MT_STORE_PARENT_DISTANCE
+#define MT_PADDING padding
+#include "mtree_template.h"
 
-	switch (PICKSPLIT_STRATEGY_INT32_ARRAY) {
-		case Random:
-			leftIndex = ((int)random()) % (maxOffset - 1);
-			rightIndex = (leftIndex + 1) + (((int)random()) % (maxOffset - leftIndex - 1));
-			break;
-		case FirstTwo:
-			leftIndex = -1;
-			rightIndex = -1;
-
-			for (int i = 0; i < maxOffset - 1; ++i) {
-				if (entries[i]->level == entries[i + 1]->level) {
-					leftIndex = i;
-					rightIndex = i + 1;
-					break;
-				}
-			}
-
-			break;
-		case MaxDistanceFromFirst:
-			maxDistance = -1.0;
-			for (int r = 0; r < maxOffset; ++r) {
-				double distance = get_int32_array_distance(maxOffset, entries, distances, 0, r);
-				if (distance > maxDistance) {
-					maxDistance = distance;
-					rightCandidateIndex = r;
-				}
-			}
-			leftIndex = 0;
-			rightIndex = rightCandidateIndex;
-			break;
-		case MaxDistancePair:
-			for (OffsetNumber l = 0; l < maxOffset; ++l) {
-				for (OffsetNumber r = l; r < maxOffset; ++r) {
-					double distance = get_int32_array_distance(maxOffset, entries, distances, l, r);
-					if (distance > maxDistance) {
-						maxDistance = distance;
-						leftCandidateIndex = l;
-						rightCandidateIndex = r;
-					}
-				}
-			}
-			leftIndex = leftCandidateIndex;
-			rightIndex = rightCandidateIndex;
-			break;
-		case SamplingMinCoveringSum:
-			for (int i = 0; i < trialCount; ++i) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; currentIndex++) {
-					double distanceLeft =
-						get_int32_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_int32_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				if (minCoveringSum == -1.0 || leftRadius + rightRadius < minCoveringSum) {
-					minCoveringSum = leftRadius + rightRadius;
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		case SamplingMinCoveringMax:
-			for (int i = 0; i < trialCount; ++i) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; ++currentIndex) {
-					double distanceLeft =
-						get_int32_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_int32_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				if (minCoveringMax == -1.0 || MAX_2(leftRadius, rightRadius) < minCoveringMax) {
-					minCoveringMax = MAX_2(leftRadius, rightRadius);
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		case SamplingMinOverlapArea:
-			for (int i = 0; i < trialCount; i++) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double distance =
-					get_int32_array_distance(maxOffset, entries, distances, leftCandidateIndex, rightCandidateIndex);
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; currentIndex++) {
-					double distanceLeft =
-						get_int32_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_int32_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				double currentOverlapArea = overlap_area(leftRadius, rightRadius, distance);
-				if (minOverlapArea == -1.0 || currentOverlapArea < minOverlapArea) {
-					minOverlapArea = currentOverlapArea;
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		case SamplingMinAreaSum:
-			for (int i = 0; i < trialCount; i++) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; currentIndex++) {
-					double distanceLeft =
-						get_int32_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_int32_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				double currentSumArea = leftRadius * leftRadius + rightRadius * rightRadius;
-				if (minSumArea == -1.0 || currentSumArea < minSumArea) {
-					minSumArea = currentSumArea;
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		default:
-			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-					errmsg("Invalid StrategyNumber for picksplit function: %u", PICKSPLIT_STRATEGY_INT32_ARRAY));
-			break;
-	}
+/*
+ * Both the = operator and the same support function of the operator class,
+ * which GiST calls with a third argument for its result.
+ */
+Datum mtree_int32_array_same(PG_FUNCTION_ARGS)
+{
+	mtree_int32_array* first = PG_GETARG_MTREE_INT32_ARRAY_P(0);
+	mtree_int32_array* second = PG_GETARG_MTREE_INT32_ARRAY_P(1);
 
-	mtree_int32_array* unionLeft = mtree_int32_array_deep_copy(entries[leftIndex]);
-	mtree_int32_array* unionRight = mtree_int32_array_deep_copy(entries[rightIndex]);
-	mtree_int32_array* current;
-
-	for (OffsetNumber i = FirstOffsetNumber; i <= maxOffset; i = OffsetNumberNext(i)) {
-		double distanceLeft = get_int32_array_distance(maxOffset, entries, distances, leftIndex, i - 1);
-		double distanceRight = get_int32_array_distance(maxOffset, entries, distances, rightIndex, i - 1);
-		current = entries[i - 1];
-
-		if (distanceLeft < distanceRight) {
-			if (distanceLeft + current->coveringRadius > unionLeft->coveringRadius) {
-				unionLeft->coveringRadius = distanceLeft + current->coveringRadius;
-			}
-			*left = i;
-			++left;
-			++(vector->spl_nleft);
-		} else {
-			if (distanceRight + current->coveringRadius > unionRight->coveringRadius) {
-				unionRight->coveringRadius = distanceRight + current->coveringRadius;
-			}
-			*right = i;
-			++right;
-			++(vector->spl_nright);
-		}
+	if (PG_NARGS() > 2) {
+		bool* result = (bool*)PG_GETARG_POINTER(2);
+		*result = mtree_key_identical(first, second);
+		PG_RETURN_POINTER(result);
 	}
 
-	vector->spl_ldatum = PointerGetDatum(unionLeft);
-	vector->spl_rdatum = PointerGetDatum(unionRight);
-
-	PG_RETURN_POINTER(vector);
+	PG_RETURN_BOOL(mtree_int32_array_equals(first, second));
 }
 
-Datum mtree_int32_array_compress(PG_FUNCTION_ARGS)
+/*
+ * The sorted build sorts stored keys.
+ */
+static double mtree_int32_array_datum_distance(Datum first, Datum second)
 {
-	PG_RETURN_POINTER(PG_GETARG_POINTER(0));
-}
+	mtree_int32_array* firstKey = mtree_int32_array_expand_key(first);
+	mtree_int32_array* secondKey = mtree_int32_array_expand_key(second);
+	double distance = mtree_int32_array_full_distance(firstKey, secondKey);
 
-Datum mtree_int32_array_decompress(PG_FUNCTION_ARGS)
-{
-	PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	pfree(firstKey);
+	pfree(secondKey);
+
+	return distance;
 }
 
-Datum mtree_int32_array_distance(PG_FUNCTION_ARGS)
+Datum mtree_int32_array_sortsupport(PG_FUNCTION_ARGS)
 {
-	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
-	mtree_int32_array* query = PG_GETARG_MTREE_INT32_ARRAY_P(1);
-	mtree_int32_array* key = DatumGetMtreeInt32Array(entry->key);
+	SortSupport ssup = (SortSupport)PG_GETARG_POINTER(0);
 
-	PG_RETURN_FLOAT8((float8)mtree_int32_array_outer_distance(query, key));
+	mtree_pivot_sortsupport(ssup, mtree_int32_array_datum_distance);
+
+	PG_RETURN_VOID();
 }
 
 Datum mtree_int32_array_distance_operator(PG_FUNCTION_ARGS)
@@ -462,6 +256,25 @@ Datum mtree_int32_array_distance_operator(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8((float8)mtree_int32_array_outer_distance(first, second));
 }
 
+/*
+ * Returns a copy of the object with the given covering radius, so that
+ * x #<# mtree_ball(q, r) is an indexed range query.
+ */
+Datum mtree_int32_array_radius(PG_FUNCTION_ARGS)
+{
+	mtree_int32_array* center = PG_GETARG_MTREE_INT32_ARRAY_P(0);
+	float8 radius = PG_GETARG_FLOAT8(1);
+
+	if (!(radius >= 0.0)) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("The radius can't be negative!"));
+	}
+
+	mtree_int32_array* result = mtree_int32_array_deep_copy(center);
+	result->coveringRadius = radius;
+
+	PG_RETURN_POINTER(result);
+}
+
 Datum mtree_int32_array_overlap_operator(PG_FUNCTION_ARGS)
 {
 	mtree_int32_array* first = PG_GETARG_MTREE_INT32_ARRAY_P(0);
@@ -488,3 +301,34 @@ Datum mtree_int32_array_contained_operator(PG_FUNCTION_ARGS)
 
 	PG_RETURN_BOOL(result);
 }
+
+/*
+ * Cross-type operators with an int4[] on the right.
+ */
+static mtree_int32_array* mtree_int32_array_native_argument(FunctionCallInfo fcinfo, int argument)
+{
+	PGFunction convert = mtree_int32_array_query_converter(get_fn_expr_argtype(fcinfo->flinfo, argument));
+
+	if (convert == NULL) {
+		ereport(ERROR, errcode(ERRCODE_DATATYPE_MISMATCH), errmsg("The argument has to be an int4[]!"));
+	}
+
+	return DatumGetMtreeInt32Array(DirectFunctionCall1(convert, PG_GETARG_DATUM(argument)));
+}
+
+Datum mtree_int32_array_native_contains_operator(PG_FUNCTION_ARGS)
+{
+	mtree_int32_array* first = PG_GETARG_MTREE_INT32_ARRAY_P(0);
+	mtree_int32_array* second = mtree_int32_array_native_argument(fcinfo, 1);
+	bool result = mtree_int32_array_contains_distance(first, second);
+
+	PG_RETURN_BOOL(result);
+}
+
+Datum mtree_int32_array_native_distance_operator(PG_FUNCTION_ARGS)
+{
+	mtree_int32_array* first = PG_GETARG_MTREE_INT32_ARRAY_P(0);
+	mtree_int32_array* second = mtree_int32_array_native_argument(fcinfo, 1);
+
+	PG_RETURN_FLOAT8((float8)mtree_int32_array_outer_distance(first, second));
+}
@@ -4,30 +4,13 @@
 
 #include "mtree_int32_array_util.h"
 
-double mtree_int32_array_outer_distance(mtree_int32_array* first, mtree_int32_array* second)
-{
-	double distance = int32_array_euclidean_distance(first, second);
-	double outer_distance = distance - first->coveringRadius - second->coveringRadius;
-
-	if (outer_distance < 0.0) {
-		outer_distance = 0.0;
-	}
-
-	return outer_distance;
-}
-
-double mtree_int32_array_full_distance(mtree_int32_array* first, mtree_int32_array* second)
-{
-	return int32_array_euclidean_distance(first, second);
-}
-
 bool mtree_int32_array_equals(mtree_int32_array* first, mtree_int32_array* second)
 {
 	if (first->arrayLength != second->arrayLength) {
 		return false;
 	}
 
-	for (unsigned char i = 0; i < first->arrayLength; ++i) {
+	for (int i = 0; i < first->arrayLength; ++i) {
 		if (first->data[i] != second->data[i]) {
 			return false;
 		}
@@ -60,18 +43,10 @@ mtree_int32_array* mtree_int32_array_deep_copy(mtree_int32_array* source)
 	return destination;
 }
 
-double get_int32_array_distance(int size, mtree_int32_array* entries[size], double distances[size][size], int i, int j)
-{
-	if (distances[i][j] == -1) {
-		distances[i][j] = mtree_int32_array_full_distance(entries[i], entries[j]);
-	}
-	return distances[i][j];
-}
-
 double int32_simple_distance(mtree_int32_array* first, mtree_int32_array* second)
 {
 	double distance = 0.0;
-	unsigned char minimumLength;  //, maximumLength;
+	int minimumLength;  //, maximumLength;
 	// mtree_int32_array* longer;
 
 	if (first->arrayLength <= second->arrayLength) {
@@ -80,7 +55,7 @@ double int32_simple_distance(mtree_int32_array* first, mtree_int32_array* second
 		minimumLength = second->arrayLength;
 	}
 
-	for (unsigned char i = 0; i < minimumLength; ++i) {
+	for (int i = 0; i < minimumLength; ++i) {
 		if (first->data[i] > second->data[i]) {
 			--distance;
 		} else {
@@ -94,7 +69,7 @@ double int32_simple_distance(mtree_int32_array* first, mtree_int32_array* second
 double int32_array_sum_distance(mtree_int32_array* first, mtree_int32_array* second)
 {
 	double distance = 0.0;
-	unsigned char minimumLength, maximumLength;
+	int minimumLength, maximumLength;
 	mtree_int32_array* longer;
 
 	if (first->arrayLength <= second->arrayLength) {
@@ -107,7 +82,7 @@ double int32_array_sum_distance(mtree_int32_array* first, mtree_int32_array* sec
 		longer = first;
 	}
 
-	for (unsigned char i = 0; i < minimumLength; ++i) {
+	for (int i = 0; i < minimumLength; ++i) {
 		if (first->data[i] != 0 || second->data[i] != 0) {
 			distance += (((first->data[i] - second->data[i]) * (first->data[i] - second->data[i])) /
 						 (first->data[i] + second->data[i]));
@@ -116,7 +91,7 @@ double int32_array_sum_distance(mtree_int32_array* first, mtree_int32_array* sec
 		}
 	}
 
-	for (unsigned char i = minimumLength; i < maximumLength; ++i) {
+	for (int i = minimumLength; i < maximumLength; ++i) {
 		distance += longer->data[i];
 	}
 
@@ -126,7 +101,7 @@ double int32_array_sum_distance(mtree_int32_array* first, mtree_int32_array* sec
 double int32_array_kullback_leibler_distance(mtree_int32_array* first, mtree_int32_array* second)
 {
 	double distance = 0.0;
-	unsigned char minimumLength, maximumLength;
+	int minimumLength, maximumLength;
 	mtree_int32_array* longer;
 
 	if (first->arrayLength <= second->arrayLength) {
@@ -139,7 +114,7 @@ double int32_array_kullback_leibler_distance(mtree_int32_array* first, mtree_int
 		longer = first;
 	}
 
-	for (unsigned char i = 0; i < minimumLength; ++i) {
+	for (int i = 0; i < minimumLength; ++i) {
 		if (second->data[i] != 0) {
 			distance += ((first->data[i] - second->data[i]) * log(first->data[i] / second->data[i]));
 		} else {
@@ -147,38 +122,10 @@ double int32_array_kullback_leibler_distance(mtree_int32_array* first, mtree_int
 		}
 	}
 
-	for (unsigned char i = minimumLength; i < maximumLength; ++i) {
+	for (int i = minimumLength; i < maximumLength; ++i) {
 		distance += longer->data[i];
 	}
 
 	return distance;
 }
 
-double int32_array_euclidean_distance(mtree_int32_array* first, mtree_int32_array* second)
-{
-	double distance = 0.0;
-	int minimumLength, maximumLength;
-	mtree_int32_array* longer;
-
-	if (first->arrayLength <= second->arrayLength) {
-		minimumLength = first->arrayLength;
-		maximumLength = second->arrayLength;
-		longer = second;
-	} else {
-		minimumLength = second->arrayLength;
-		maximumLength = first->arrayLength;
-		longer = first;
-	}
-
-	for (int i = 0; i < minimumLength; ++i) {
-		double diff = (double)first->data[i] - (double)second->data[i];
-		distance += diff * diff;
-	}
-
-	for (int i = minimumLength; i < maximumLength; ++i) {
-		double value = (double)(longer->data[i]);
-		distance += value * value;
-	}
-
-	return sqrt(distance);
-}
@@ -6,14 +6,37 @@
 #define __MTREE_INT32_UTIL_H__
 
 #include "mtree_int32.h"
+#include "mtree_util.h"
 
-double mtree_int32_outer_distance(mtree_int32* first, mtree_int32* second);
-double mtree_int32_full_distance(mtree_int32* first, mtree_int32* second);
 bool mtree_int32_equals(mtree_int32* first, mtree_int32* second);
 bool mtree_int32_overlap_distance(mtree_int32* first, mtree_int32* second);
 bool mtree_int32_contains_distance(mtree_int32* first, mtree_int32* second);
 bool mtree_int32_contained_distance(mtree_int32* first, mtree_int32* second);
 mtree_int32* mtree_int32_deep_copy(mtree_int32* source);
-double get_int32_distance(int size, mtree_int32* entries[size], double distances[size][size], int i, int j);
+
+static inline double mtree_int32_full_distance(mtree_int32* first, mtree_int32* second)
+{
+	return abs(first->data - second->data);
+}
+
+static inline double mtree_int32_outer_distance(mtree_int32* first, mtree_int32* second)
+{
+	double distance = abs(first->data - second->data);
+	double outer_distance = distance - first->coveringRadius - second->coveringRadius;
+
+	if (outer_distance < 0.0) {
+		outer_distance = 0.0;
+	}
+
+	return outer_distance;
+}
+
+/*
+ * Distance from the reference object (zero), stored in parentDistance.
+ */
+static inline double mtree_int32_reference_distance(mtree_int32* key)
+{
+	return fabs((double)key->data);
+}
 
 #endif
@@ -0,0 +1,219 @@
+/*
+ * contrib/mtree_gist/mtree_sort.c
+ */
+
+#include "mtree_sort.h"
+
+#include <float.h>
+
+#include "fmgr.h"
+
+/*
+ * Number of seed objects per level of the clustered sorted build
+ * (mtree_gist.build_seeds). Zero falls back to a single pivot.
+ */
+int mtree_build_seeds = MTREE_DEFAULT_BUILD_SEEDS;
+
+/*
+ * A seed object of the clustered sorted build and the seeds of its cluster.
+ */
+typedef struct {
+	struct varlena* key;
+	int childCount;
+	struct varlena** children;
+} MtreeSortSeed;
+
+/*
+ * Sort state of the sortsupport. In pivot mode the pivot is the first key the
+ * sort sees. In clustered mode the seeds are the first keys of every cluster,
+ * all of them copied into the sort's memory context.
+ */
+typedef struct {
+	MtreeDatumDistance distance;
+	struct varlena* pivot;
+	int seedCount;
+	int topCount;
+	MtreeSortSeed* seeds;
+} MtreeSortState;
+
+static struct varlena* mtree_sort_copy_key(SortSupport ssup, Datum datum)
+{
+	struct varlena* source = PG_DETOAST_DATUM(datum);
+	struct varlena* destination = (struct varlena*)MemoryContextAlloc(ssup->ssup_cxt, VARSIZE_ANY(source));
+	memcpy(destination, source, VARSIZE_ANY(source));
+	return destination;
+}
+
+/* Treat NaN and -0.0 as zero, so that the abbreviated keys stay ordered. */
+static double mtree_sort_distance(MtreeSortState* state, struct varlena* key, Datum datum)
+{
+	double distance = state->distance(PointerGetDatum(key), datum);
+	return distance > 0.0 ? distance : 0.0;
+}
+
+static double mtree_sort_pivot_distance(SortSupport ssup, Datum datum)
+{
+	MtreeSortState* state = (MtreeSortState*)ssup->ssup_extra;
+
+	if (state->pivot == NULL) {
+		state->pivot = mtree_sort_copy_key(ssup, datum);
+	}
+
+	return mtree_sort_distance(state, state->pivot, datum);
+}
+
+static int mtree_pivot_cmp(Datum first, Datum second, SortSupport ssup)
+{
+	double firstDistance = mtree_sort_pivot_distance(ssup, first);
+	double secondDistance = mtree_sort_pivot_distance(ssup, second);
+
+	if (firstDistance < secondDistance) {
+		return -1;
+	} else if (firstDistance > secondDistance) {
+		return 1;
+	}
+
+	return 0;
+}
+
+#if SIZEOF_DATUM >= 8
+/*
+ * Returns the index of the nearest key, the lowest one on ties.
+ */
+static int mtree_sort_nearest(MtreeSortState* state, struct varlena** keys, int count, Datum datum,
+							  double* nearestDistance)
+{
+	int nearest = 0;
+	*nearestDistance = mtree_sort_distance(state, keys[0], datum);
+
+	for (int i = 1; i < count && *nearestDistance > 0.0; ++i) {
+		double distance = mtree_sort_distance(state, keys[i], datum);
+		if (distance < *nearestDistance) {
+			*nearestDistance = distance;
+			nearest = i;
+		}
+	}
+
+	return nearest;
+}
+
+/*
+ * The abbreviated key of the clustered build is (top level seed, seed within
+ * its cluster, distance from that seed), the distance being the bit pattern
+ * of a non-negative float, which orders the same way as its value.
+ *
+ * Seeds are taken from the keys as they arrive, the first keys of the sort
+ * become the top level seeds and the first keys of a cluster become the seeds
+ * of that cluster. A seed is at distance zero from itself and the nearest
+ * search prefers lower indexes, so recomputing the key of any datum later
+ * (when every seed list is already full) gives back the same value. This is
+ * what makes the abbreviated keys agree with mtree_cluster_cmp.
+ */
+static uint64 mtree_cluster_key(SortSupport ssup, Datum datum, bool addSeeds)
+{
+	MtreeSortState* state = (MtreeSortState*)ssup->ssup_extra;
+	struct varlena* topKeys[state->seedCount];
+	double distance = 0.0;
+	int top = 0;
+	int child = 0;
+
+	for (int i = 0; i < state->topCount; ++i) {
+		topKeys[i] = state->seeds[i].key;
+	}
+
+	if (state->topCount > 0) {
+		top = mtree_sort_nearest(state, topKeys, state->topCount, datum, &distance);
+	}
+
+	if (state->topCount == 0 || (distance > 0.0 && state->topCount < state->seedCount && addSeeds)) {
+		MtreeSortSeed* seed = &state->seeds[state->topCount];
+
+		seed->key = mtree_sort_copy_key(ssup, datum);
+		seed->children =
+			(struct varlena**)MemoryContextAlloc(ssup->ssup_cxt, state->seedCount * sizeof(struct varlena*));
+		seed->children[0] = seed->key;
+		seed->childCount = 1;
+
+		return ((uint64)(state->topCount++) << 48);
+	}
+
+	MtreeSortSeed* seed = &state->seeds[top];
+
+	child = mtree_sort_nearest(state, seed->children, seed->childCount, datum, &distance);
+
+	if (distance > 0.0 && seed->childCount < state->seedCount && addSeeds) {
+		seed->children[seed->childCount] = mtree_sort_copy_key(ssup, datum);
+		return ((uint64)top << 48) | ((uint64)(seed->childCount++) << 32);
+	}
+
+	float4 shortDistance = (float4)distance;
+	uint32 distanceBits;
+
+	/* Rounding to float must not make the key smaller than a seed's key. */
+	if (shortDistance == 0.0f) {
+		shortDistance = FLT_MIN;
+	}
+	memcpy(&distanceBits, &shortDistance, sizeof(distanceBits));
+
+	return ((uint64)top << 48) | ((uint64)child << 32) | distanceBits;
+}
+
+static Datum mtree_cluster_abbrev_convert(Datum original, SortSupport ssup)
+{
+	return UInt64GetDatum(mtree_cluster_key(ssup, original, true));
+}
+
+static int mtree_cluster_cmp(Datum first, Datum second, SortSupport ssup)
+{
+	uint64 firstKey = mtree_cluster_key(ssup, first, false);
+	uint64 secondKey = mtree_cluster_key(ssup, second, false);
+
+	if (firstKey < secondKey) {
+		return -1;
+	} else if (firstKey > secondKey) {
+		return 1;
+	}
+
+	return 0;
+}
+
+static bool mtree_cluster_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	return false;
+}
+#endif
+
+/*
+ * Sortsupport for the sorted GiST build.
+ *
+ * By default the keys are clustered in the spirit of the Ciaccia-Patella
+ * bulk loading algorithm: every key is assigned to its nearest seed, then to
+ * the nearest seed within that cluster, and the keys of such a subcluster are
+ * ordered by their distance from its seed. The sorted build then packs the
+ * leaf pages (and every level above them) bottom-up from consecutive keys, so
+ * a page holds the members of a single subcluster whenever possible.
+ *
+ * Without abbreviated keys, or with mtree_gist.build_seeds set to zero, the
+ * keys are simply ordered by their distance from a pivot.
+ */
+void mtree_pivot_sortsupport(SortSupport ssup, MtreeDatumDistance distance)
+{
+	MtreeSortState* state = (MtreeSortState*)MemoryContextAllocZero(ssup->ssup_cxt, sizeof(MtreeSortState));
+	state->distance = distance;
+	ssup->ssup_extra = state;
+
+#if SIZEOF_DATUM >= 8
+	if (ssup->abbreviate && mtree_build_seeds > 0) {
+		state->seedCount = mtree_build_seeds;
+		state->seeds = (MtreeSortSeed*)MemoryContextAllocZero(ssup->ssup_cxt, state->seedCount * sizeof(MtreeSortSeed));
+
+		ssup->comparator = ssup_datum_unsigned_cmp;
+		ssup->abbrev_converter = mtree_cluster_abbrev_convert;
+		ssup->abbrev_abort = mtree_cluster_abbrev_abort;
+		ssup->abbrev_full_comparator = mtree_cluster_cmp;
+		return;
+	}
+#endif
+
+	ssup->comparator = mtree_pivot_cmp;
+}
@@ -0,0 +1,23 @@
+/*
+ * contrib/mtree_gist/mtree_sort.h
+ */
+
+#ifndef __MTREE_SORT_H__
+#define __MTREE_SORT_H__
+
+#include "postgres.h"
+#include "utils/sortsupport.h"
+
+/*
+ * Full distance between two (possibly toasted) stored keys of the same type.
+ */
+typedef double (*MtreeDatumDistance)(Datum first, Datum second);
+
+#define MTREE_DEFAULT_BUILD_SEEDS 16
+#define MTREE_MAX_BUILD_SEEDS 1024
+
+extern int mtree_build_seeds;
+
+void mtree_pivot_sortsupport(SortSupport ssup, MtreeDatumDistance distance);
+
+#endif
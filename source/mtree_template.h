@@ -0,0 +1,1085 @@
+/*
+ * contrib/mtree_gist/mtree_template.h
+ *
+ * Generates the consistent, distance, compress, decompress, fetch, union,
+ * penalty and picksplit support functions of an M-tree operator class.
+ * Every type shares the same implementation of the split strategies, while the
+ * compiler can still inline the distance kernel of the type into their inner
+ * loops.
+ *
+ * Usage notes:
+ *
+ *	  To generate the functions, the following parameter macros should be
+ *	  defined before including this file:
+ *
+ *	  - MT_TYPE - the key type, e.g. mtree_float_array
+ *	  - MT_PREFIX - prefix of the generated functions and of the type's
+ *		helpers, e.g. mtree_float_array generates mtree_float_array_union and
+ *		uses mtree_float_array_full_distance
+ *	  - MT_DATUM_GET - converts a Datum to an MT_TYPE pointer
+ *
+ *	  The type has to provide MT_PREFIX_full_distance and
+ *	  MT_PREFIX_reference_distance (preferably static inline in its util
+ *	  header), MT_PREFIX_equals, MT_PREFIX_deep_copy and its input function
+ *	  MT_PREFIX_input, which parses the pivots.
+ *
+ *	  Optionally, for vector types with data[] and arrayLength members:
+ *
+ *	  - MT_VECTOR_ELEMENT - converts a double coordinate to an element of
+ *		data[], e.g. (float), enables the MinimumEnclosingBall union strategy
+ *		and the sketch options, which raise an error otherwise
+ *	  - MT_STORE_PARENT_DISTANCE - keeps parentDistance in the stored keys
+ *		instead of recomputing it in decompress, for costly reference distances
+ *	  - MT_PADDING - the member aligning the payload of the type, which is
+ *		left out of the stored keys
+ *	  - MT_QUANTIZE - stores the centers of internal keys with 8 bit codes when
+ *		the quantize option is set, for float4 data[] elements, other types
+ *		raise an error for this option
+ *
+ *	  for types whose distance does not satisfy the triangle inequality:
+ *
+ *	  - MT_NOT_METRIC - disables the pivots option, which then raises an error
+ *
+ *	  and for types that preprocess the query of a scan:
+ *
+ *	  - MT_PREPARE_QUERY - returns the preprocessed form of a query, allocated
+ *		in the current memory context, kept in the query cache of the scan
+ *	  - MT_QUERY_DISTANCE - computes the distance of a key from the query of a
+ *		query cache, by default with MT_PREFIX_full_distance
+ *	  - MT_SHARE_DISTANCE - memoizes the distance computed by consistent for
+ *		the distance function of scans that also order, worth it when
+ *		distances are expensive
+ *
+ *	  and for types with cross-type operators:
+ *
+ *	  - MT_QUERY_CONVERTER - returns the function converting a query of the
+ *		given type (the subtype of the scan key) to MT_TYPE, or NULL if the
+ *		query is an MT_TYPE
+ *
+ *	  The generated functions still need their PG_FUNCTION_INFO_V1 macros.
+ *	  All parameter macros are undefined at the end of this file, so it can be
+ *	  included once per type.
+ */
+
+#include "common/hashfn.h"
+
+#include "mtree_gist.h"
+#include "mtree_util.h"
+
+#define MT_MAKE_PREFIX(a) CppConcat(a, _)
+#define MT_MAKE_NAME(name) MT_MAKE_NAME_(MT_MAKE_PREFIX(MT_PREFIX), name)
+#define MT_MAKE_NAME_(a, b) CppConcat(a, b)
+
+#define MT_FULL_DISTANCE MT_MAKE_NAME(full_distance)
+#define MT_REFERENCE_DISTANCE MT_MAKE_NAME(reference_distance)
+#define MT_DEEP_COPY MT_MAKE_NAME(deep_copy)
+#define MT_EQUALS MT_MAKE_NAME(equals)
+#define MT_INPUT MT_MAKE_NAME(input)
+
+#ifndef MT_QUERY_DISTANCE
+#define MT_QUERY_DISTANCE(cache, key) MT_FULL_DISTANCE((MT_TYPE*)(cache)->query, key)
+#endif
+
+/*
+ * Returns the number of rings at the end of the keys of the index.
+ */
+static inline int MT_MAKE_NAME(ring_count)(FunctionCallInfo fcinfo)
+{
+#ifdef MT_VECTOR_ELEMENT
+	return mtree_pivot_count(fcinfo) + mtree_sketch_count(fcinfo, NULL);
+#else
+	return mtree_pivot_count(fcinfo);
+#endif
+}
+
+#ifdef MT_VECTOR_ELEMENT
+/*
+ * Projects a vector on the sketch directions: the first dimensions
+ * coordinates with pseudo-random signs, scaled to unit length. The difference
+ * of two projections never exceeds the Euclidean distance of the vectors.
+ */
+static void MT_MAKE_NAME(sketch)(MT_TYPE* key, int count, int dimensions, double* projections)
+{
+	int length = MIN_2(key->arrayLength, dimensions);
+	double scale = 1.0 / sqrt((double)dimensions);
+
+	for (int p = 0; p < count; ++p) {
+		double sum = 0.0;
+
+		for (int start = 0; start < length; start += 64) {
+			uint64 signs = mtree_sketch_signs(p, start / 64);
+			int end = MIN_2(length, start + 64);
+
+			for (int j = start; j < end; ++j, signs >>= 1) {
+				sum += (signs & 1) ? (double)key->data[j] : -(double)key->data[j];
+			}
+		}
+
+		projections[p] = sum * scale;
+	}
+}
+#endif
+
+#ifndef MT_NOT_METRIC
+/*
+ * Returns a copy of a leaf key followed by its rings, the interval of the
+ * distances between each pivot and the points of its ball, then the interval
+ * of their sketch projections.
+ */
+static MT_TYPE* MT_MAKE_NAME(attach_rings)(MT_TYPE* key, MtreePivots* pivots, int sketchCount, int sketchDimensions)
+{
+	Size size = VARSIZE_ANY(key);
+	int ringCount = pivots->count + sketchCount;
+	Size ringsSize = ringCount * sizeof(MtreeRing);
+	MT_TYPE* out = (MT_TYPE*)palloc(size + ringsSize);
+
+	memcpy(out, key, size);
+	SET_VARSIZE(out, size + ringsSize);
+
+	MtreeRing* rings = mtree_key_rings(out, ringCount);
+	for (int p = 0; p < pivots->count; ++p) {
+		double distance = MT_FULL_DISTANCE(key, MT_DATUM_GET(pivots->values[p]));
+		rings[p].lower = mtree_distance_round_down(MAX_2(distance - key->coveringRadius, 0.0));
+		rings[p].upper = mtree_distance_round_up(distance + key->coveringRadius);
+	}
+
+#ifdef MT_VECTOR_ELEMENT
+	if (sketchCount > 0) {
+		double projections[MTREE_MAX_SKETCH_PROJECTIONS];
+
+		MT_MAKE_NAME(sketch)(key, sketchCount, sketchDimensions, projections);
+		rings += pivots->count;
+		for (int p = 0; p < sketchCount; ++p) {
+			rings[p].lower = mtree_distance_round_down(projections[p] - key->coveringRadius);
+			rings[p].upper = mtree_distance_round_up(projections[p] + key->coveringRadius);
+		}
+	}
+#else
+	(void)sketchDimensions;
+#endif
+
+	return out;
+}
+
+/*
+ * Sets the rings of a new internal key to the union of the rings of its
+ * entries.
+ */
+static void MT_MAKE_NAME(union_rings)(MT_TYPE* key, int ringCount, MT_TYPE* entries[], int size)
+{
+	MtreeRing* rings = mtree_key_rings(key, ringCount);
+
+	for (int p = 0; p < ringCount; ++p) {
+		float4 lower = INFINITY;
+		float4 upper = -INFINITY;
+
+		for (int i = 0; i < size; ++i) {
+			MtreeRing* entryRings = mtree_key_rings(entries[i], ringCount);
+			lower = MIN_2(lower, entryRings[p].lower);
+			upper = MAX_2(upper, entryRings[p].upper);
+		}
+
+		rings[p].lower = lower;
+		rings[p].upper = upper;
+	}
+}
+#endif
+
+/*
+ * Returns the cached state of the query of a scan: the detoasted query, its
+ * preprocessed form, its distance from the reference object and the values
+ * compared with the rings of the keys.
+ */
+static inline MtreeQueryCache* MT_MAKE_NAME(query_cache)(FunctionCallInfo fcinfo, Datum queryDatum, Oid subtype)
+{
+	bool isNewQuery;
+#ifdef MT_QUERY_CONVERTER
+	PGFunction convert = MT_QUERY_CONVERTER(subtype);
+#else
+	PGFunction convert = NULL;
+#endif
+	MtreeQueryCache* cache = mtree_query_cache_get(fcinfo, queryDatum, convert, &isNewQuery);
+
+	if (isNewQuery) {
+		MT_TYPE* query = (MT_TYPE*)cache->query;
+
+		cache->referenceDistance = MT_REFERENCE_DISTANCE(query);
+#ifdef MT_SHARE_DISTANCE
+		MT_TYPE* sharedQuery = (MT_TYPE*)MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, VARSIZE_ANY(query));
+
+		memcpy(sharedQuery, query, VARSIZE_ANY(query));
+		sharedQuery->coveringRadius = 0.0;
+		cache->sharedQuery = (char*)sharedQuery;
+		cache->queryHash = hash_bytes((const unsigned char*)sharedQuery, VARSIZE_ANY(sharedQuery));
+#endif
+#ifdef MT_PREPARE_QUERY
+		MemoryContext oldContext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+		cache->prepared = MT_PREPARE_QUERY(query);
+		MemoryContextSwitchTo(oldContext);
+#endif
+#ifndef MT_NOT_METRIC
+		if (cache->pivots == NULL) {
+			cache->pivots = mtree_pivots_get(fcinfo, MT_INPUT);
+		}
+		for (int p = 0; p < cache->pivots->count; ++p) {
+			cache->ringValues[p] = MT_QUERY_DISTANCE(cache, MT_DATUM_GET(cache->pivots->values[p]));
+		}
+		cache->ringCount = cache->pivots->count;
+#endif
+#ifdef MT_VECTOR_ELEMENT
+		int sketchDimensions;
+		int sketchCount = mtree_sketch_count(fcinfo, &sketchDimensions);
+
+		if (sketchCount > 0) {
+			MT_MAKE_NAME(sketch)(query, sketchCount, sketchDimensions, cache->ringValues + cache->ringCount);
+			cache->ringCount += sketchCount;
+		}
+#endif
+	}
+
+	return cache;
+}
+
+/*
+ * Decides whether the consistent function would reject a key without
+ * computing its distance from the query, by the triangle inequality through
+ * the reference object (see parentDistance) and through the pivots, and by
+ * the sketch projections.
+ */
+static inline bool MT_MAKE_NAME(excludes)(MtreeQueryCache* cache, MT_TYPE* key, StrategyNumber strategyNumber,
+										  bool isLeaf)
+{
+	MT_TYPE* query = (MT_TYPE*)cache->query;
+	double lowerBound = fabs(cache->referenceDistance - key->parentDistance);
+
+	if (mtree_lower_bound_excludes(strategyNumber, isLeaf, lowerBound, query->coveringRadius, key->coveringRadius)) {
+		return true;
+	}
+
+	if (cache->ringCount == 0) {
+		return false;
+	}
+
+	return mtree_rings_exclude(strategyNumber, isLeaf, mtree_key_rings(key, cache->ringCount), cache->ringValues,
+							   cache->ringCount, query->coveringRadius);
+}
+
+Datum MT_MAKE_NAME(consistent)(PG_FUNCTION_ARGS)
+{
+	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	StrategyNumber strategyNumber = (StrategyNumber)PG_GETARG_UINT16(2);
+	bool* recheck = (bool*)PG_GETARG_POINTER(4);
+	MT_TYPE* key = MT_DATUM_GET(entry->key);
+	MtreeQueryCache* cache = MT_MAKE_NAME(query_cache)(fcinfo, PG_GETARG_DATUM(1), PG_GETARG_OID(3));
+	MT_TYPE* query = (MT_TYPE*)cache->query;
+
+	*recheck = false;
+
+	if (MT_MAKE_NAME(excludes)(cache, key, strategyNumber, GIST_LEAF(entry))) {
+		PG_RETURN_BOOL(false);
+	}
+
+	if (GIST_LEAF(entry) && strategyNumber == GIST_SN_SAME) {
+		PG_RETURN_BOOL(MT_EQUALS(key, query));
+	}
+
+	double distance = MT_QUERY_DISTANCE(cache, key);
+#ifdef MT_SHARE_DISTANCE
+	mtree_distance_memo_store(cache, key, distance);
+#endif
+
+	PG_RETURN_BOOL(mtree_distance_consistent(strategyNumber, GIST_LEAF(entry), distance, query->coveringRadius,
+											 key->coveringRadius));
+}
+
+/*
+ * Distance of a key from the query in an ordered scan. Leaf distances are
+ * exact, as index-only scans can not recheck them. Internal keys may get a
+ * larger lower bound from their rings than from their ball, which moves
+ * subtrees far from the query back in the queue of the scan.
+ */
+Datum MT_MAKE_NAME(distance)(PG_FUNCTION_ARGS)
+{
+	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	MT_TYPE* key = MT_DATUM_GET(entry->key);
+	MtreeQueryCache* cache = MT_MAKE_NAME(query_cache)(fcinfo, PG_GETARG_DATUM(1), PG_GETARG_OID(3));
+	MT_TYPE* query = (MT_TYPE*)cache->query;
+
+	double distance;
+
+#ifdef MT_SHARE_DISTANCE
+	if (!mtree_distance_memo_lookup(cache, key, &distance)) {
+		distance = MT_QUERY_DISTANCE(cache, key);
+	}
+#else
+	distance = MT_QUERY_DISTANCE(cache, key);
+#endif
+	distance = MAX_2(distance - query->coveringRadius - key->coveringRadius, 0.0);
+
+	if (!GIST_LEAF(entry) && cache->ringCount > 0) {
+		double ringsDistance = mtree_rings_distance(mtree_key_rings(key, cache->ringCount), cache->ringValues,
+													cache->ringCount, query->coveringRadius);
+		distance = MAX_2(distance, ringsDistance);
+	}
+
+	PG_RETURN_FLOAT8((float8)distance);
+}
+
+/*
+ * Returns the distance between the i-th and j-th entries of a split, cached
+ * in the picksplit workspace if the split fits in it.
+ */
+static inline double MT_MAKE_NAME(cached_distance)(MtreePickSplitWorkspace* workspace, MT_TYPE* entries[], int i,
+												   int j)
+{
+	if (i == j) {
+		return 0.0;
+	}
+
+	float4* cell = mtree_distance_matrix_cell(workspace, i, j);
+
+	if (cell == NULL) {
+		return MT_FULL_DISTANCE(entries[i], entries[j]);
+	}
+
+	if (isnan(*cell)) {
+		*cell = mtree_distance_round_up(MT_FULL_DISTANCE(entries[i], entries[j]));
+	}
+
+	return *cell;
+}
+
+/*
+ * Distributes the entries between the given routing entries and computes the
+ * covering radii of the two nodes. The side of every entry is stored in
+ * toLeft, unless it is NULL.
+ */
+static inline void MT_MAKE_NAME(distribute)(MtreeDistribution distribution, MtreePickSplitWorkspace* workspace,
+											MT_TYPE* entries[], int size, int leftIndex, int rightIndex, bool* toLeft,
+											double* leftRadius, double* rightRadius)
+{
+	*leftRadius = 0.0;
+	*rightRadius = 0.0;
+
+	if (distribution == Balanced) {
+		MtreeDistanceIndex byLeft[size];
+		MtreeDistanceIndex byRight[size];
+		bool assigned[size];
+
+		for (int currentIndex = 0; currentIndex < size; ++currentIndex) {
+			byLeft[currentIndex].distance = MT_MAKE_NAME(cached_distance)(workspace, entries, leftIndex, currentIndex);
+			byLeft[currentIndex].index = currentIndex;
+			byRight[currentIndex].distance = MT_MAKE_NAME(cached_distance)(workspace, entries, rightIndex, currentIndex);
+			byRight[currentIndex].index = currentIndex;
+			assigned[currentIndex] = false;
+		}
+
+		qsort(byLeft, size, sizeof(MtreeDistanceIndex), mtree_distance_index_cmp);
+		qsort(byRight, size, sizeof(MtreeDistanceIndex), mtree_distance_index_cmp);
+
+		int leftPosition = 0, rightPosition = 0;
+
+		for (int n = 0; n < size; ++n) {
+			bool assignLeft = n % 2 == 0;
+			MtreeDistanceIndex* nearest = assignLeft ? byLeft : byRight;
+			int* position = assignLeft ? &leftPosition : &rightPosition;
+			double* radius = assignLeft ? leftRadius : rightRadius;
+
+			while (assigned[nearest[*position].index]) {
+				++(*position);
+			}
+
+			int currentIndex = nearest[*position].index;
+			assigned[currentIndex] = true;
+
+			if (nearest[*position].distance + entries[currentIndex]->coveringRadius > *radius) {
+				*radius = nearest[*position].distance + entries[currentIndex]->coveringRadius;
+			}
+			if (toLeft != NULL) {
+				toLeft[currentIndex] = assignLeft;
+			}
+		}
+
+		return;
+	}
+
+	for (int currentIndex = 0; currentIndex < size; ++currentIndex) {
+		double distanceLeft = MT_MAKE_NAME(cached_distance)(workspace, entries, leftIndex, currentIndex);
+		double distanceRight = MT_MAKE_NAME(cached_distance)(workspace, entries, rightIndex, currentIndex);
+
+		if (distanceLeft < distanceRight) {
+			if (distanceLeft + entries[currentIndex]->coveringRadius > *leftRadius) {
+				*leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
+			}
+		} else {
+			if (distanceRight + entries[currentIndex]->coveringRadius > *rightRadius) {
+				*rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
+			}
+		}
+		if (toLeft != NULL) {
+			toLeft[currentIndex] = distanceLeft < distanceRight;
+		}
+	}
+}
+
+/*
+ * Objective of the sampling strategies (and GuttmanPolyTime) for a pair of
+ * routing entries, lower is better.
+ */
+static inline double MT_MAKE_NAME(split_cost)(MtreePickSplitStrategy strategy, MtreeDistribution distribution,
+											  MtreePickSplitWorkspace* workspace, MT_TYPE* entries[], int size,
+											  int leftIndex, int rightIndex)
+{
+	double leftRadius, rightRadius;
+
+	MT_MAKE_NAME(distribute)(distribution, workspace, entries, size, leftIndex, rightIndex, NULL, &leftRadius,
+							 &rightRadius);
+
+	switch (strategy) {
+		case SamplingMinCoveringSum:
+			return leftRadius + rightRadius;
+		case SamplingMinCoveringMax:
+		case MinMaxRadius:
+			return MAX_2(leftRadius, rightRadius);
+		case SamplingMinAreaSum:
+			return leftRadius * leftRadius + rightRadius * rightRadius;
+		default:
+			return overlap_area(leftRadius, rightRadius,
+								MT_MAKE_NAME(cached_distance)(workspace, entries, leftIndex, rightIndex));
+	}
+}
+
+/*
+ * Covering radius of a ball around entries[center] holding every entry, or
+ * any value above limit if it would exceed limit.
+ */
+static inline double MT_MAKE_NAME(covering_radius)(MT_TYPE* entries[], int size, int center, double limit)
+{
+	double coveringRadius = entries[center]->coveringRadius;
+
+	for (int i = 0; i < size && coveringRadius <= limit; ++i) {
+		if (i != center) {
+			double radius = MT_FULL_DISTANCE(entries[center], entries[i]) + entries[i]->coveringRadius;
+			if (radius > coveringRadius) {
+				coveringRadius = radius;
+			}
+		}
+	}
+
+	return coveringRadius;
+}
+
+#ifdef MT_VECTOR_ELEMENT
+/*
+ * Approximates the minimum enclosing ball of the entries (balls themselves)
+ * with the Badoiu-Clarkson iteration: the center repeatedly moves towards the
+ * farthest point of the farthest ball by a shrinking step. The best center
+ * seen is returned as a new key, with the covering radius computed exactly
+ * around its rounded coordinates. The first center is entries[0], so the ball
+ * is never larger than the one of the First union strategy. Room is left for
+ * the rings of the key.
+ */
+static MT_TYPE* MT_MAKE_NAME(enclosing_ball)(MT_TYPE* entries[], int size, int ringCount)
+{
+	int dimension = 0;
+	for (int i = 0; i < size; ++i) {
+		dimension = MAX_2(dimension, entries[i]->arrayLength);
+	}
+
+	double* center = (double*)palloc(dimension * sizeof(double));
+	double* bestCenter = (double*)palloc(dimension * sizeof(double));
+	double bestRadius = INFINITY;
+
+	for (int j = 0; j < dimension; ++j) {
+		center[j] = j < entries[0]->arrayLength ? (double)entries[0]->data[j] : 0.0;
+	}
+
+	for (int k = 1; k <= MTREE_ENCLOSING_BALL_ITERATIONS; ++k) {
+		int farthest = 0;
+		double farthestDistance = 0.0;
+		double farthestRadius = -1.0;
+
+		for (int i = 0; i < size; ++i) {
+			double distance = 0.0;
+			int length = entries[i]->arrayLength;
+			for (int j = 0; j < length; ++j) {
+				double difference = center[j] - (double)entries[i]->data[j];
+				distance += difference * difference;
+			}
+			for (int j = length; j < dimension; ++j) {
+				distance += center[j] * center[j];
+			}
+			distance = sqrt(distance);
+
+			if (distance + entries[i]->coveringRadius > farthestRadius) {
+				farthestRadius = distance + entries[i]->coveringRadius;
+				farthestDistance = distance;
+				farthest = i;
+			}
+		}
+
+		if (farthestRadius < bestRadius) {
+			bestRadius = farthestRadius;
+			memcpy(bestCenter, center, dimension * sizeof(double));
+		}
+
+		/* The farthest ball is centered here, the center can not improve. */
+		if (farthestDistance == 0.0) {
+			break;
+		}
+
+		double step = farthestRadius / (farthestDistance * (k + 1));
+		for (int j = 0; j < dimension; ++j) {
+			double coordinate = j < entries[farthest]->arrayLength ? (double)entries[farthest]->data[j] : 0.0;
+			center[j] += (coordinate - center[j]) * step;
+		}
+	}
+
+	size_t keySize = sizeof(MT_TYPE) + dimension * sizeof(entries[0]->data[0]) + ringCount * sizeof(MtreeRing);
+	MT_TYPE* out = (MT_TYPE*)palloc0(keySize);
+	SET_VARSIZE(out, keySize);
+	out->level = entries[0]->level;
+	out->arrayLength = dimension;
+	for (int j = 0; j < dimension; ++j) {
+		out->data[j] = MT_VECTOR_ELEMENT(bestCenter[j]);
+	}
+	pfree(center);
+	pfree(bestCenter);
+
+	for (int i = 0; i < size; ++i) {
+		double radius = MT_FULL_DISTANCE(out, entries[i]) + entries[i]->coveringRadius;
+		if (radius > out->coveringRadius) {
+			out->coveringRadius = radius;
+		}
+	}
+	out->parentDistance = MT_REFERENCE_DISTANCE(out);
+
+	return out;
+}
+#endif
+
+static const MtreeKeyLayout MT_MAKE_NAME(layout) = {
+	offsetof(MT_TYPE, coveringRadius),
+	offsetof(MT_TYPE, level),
+	offsetof(MT_TYPE, parentDistance),
+#ifdef MT_PADDING
+	offsetof(MT_TYPE, MT_PADDING),
+	sizeof(((MT_TYPE*)NULL)->MT_PADDING),
+#else
+	0,
+	0,
+#endif
+#ifdef MT_QUANTIZE
+	offsetof(MT_TYPE, arrayLength),
+	offsetof(MT_TYPE, data),
+#else
+	0,
+	0,
+#endif
+};
+
+#ifdef MT_QUANTIZE
+/*
+ * Moves the center of an internal key to the point its quantization codes
+ * represent, growing the covering radius by the distance moved so that the
+ * ball still covers the subtree. Returns NULL if the key can't be quantized
+ * or the codes would not be shorter than the coordinates.
+ */
+static MT_TYPE* MT_MAKE_NAME(quantize)(MT_TYPE* key, MtreeQuantization* quantization)
+{
+	if (key->arrayLength * (sizeof(key->data[0]) - sizeof(int8)) <= 2 * sizeof(float4)) {
+		return NULL;
+	}
+
+	MT_TYPE* out = MT_DEEP_COPY(key);
+
+	quantization->codes = (int8*)palloc(key->arrayLength * sizeof(int8));
+	if (!mtree_quantize(key->data, key->arrayLength, quantization)) {
+		pfree(quantization->codes);
+		pfree(out);
+		return NULL;
+	}
+
+	for (int i = 0; i < key->arrayLength; ++i) {
+		out->data[i] = mtree_dequantize(quantization, quantization->codes[i]);
+	}
+	out->coveringRadius = key->coveringRadius + MT_FULL_DISTANCE(key, out);
+	out->parentDistance = MT_REFERENCE_DISTANCE(out);
+
+	return out;
+}
+#endif
+
+/*
+ * Returns the full form of a stored key, see MTREE_KEY_INTERNAL.
+ */
+static MT_TYPE* MT_MAKE_NAME(expand_key)(Datum stored)
+{
+	bool hasParentDistance;
+	MT_TYPE* key = (MT_TYPE*)mtree_key_expand(MT_DATUM_GET(stored), &MT_MAKE_NAME(layout), &hasParentDistance);
+
+	if (!hasParentDistance) {
+		key->parentDistance = MT_REFERENCE_DISTANCE(key);
+	}
+
+	return key;
+}
+
+/*
+ * Raises an error for the options of the index that the type does not
+ * support.
+ */
+static void MT_MAKE_NAME(check_options)(FunctionCallInfo fcinfo)
+{
+	if (!PG_HAS_OPCLASS_OPTIONS()) {
+		return;
+	}
+
+	MtreeOptions* options = (MtreeOptions*)PG_GET_OPCLASS_OPTIONS();
+
+#ifndef MT_QUANTIZE
+	if (options->quantize) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("Only the keys of mtree_float_array can be quantized!"));
+	}
+#endif
+#ifndef MT_VECTOR_ELEMENT
+	if (options->sketch_projections > 0 || options->sketch_dimensions > 0) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("Only mtree_float_array and mtree_int32_array support sketches!"));
+	}
+#endif
+	(void)options;
+}
+
+/*
+ * Stores keys in their compact form. Leaf keys of an index with pivots get
+ * their rings here, internal keys in union and picksplit.
+ */
+Datum MT_MAKE_NAME(compress)(PG_FUNCTION_ARGS)
+{
+	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	GISTENTRY* retval = (GISTENTRY*)palloc(sizeof(GISTENTRY));
+	MT_TYPE* key = MT_DATUM_GET(entry->key);
+
+#ifdef MT_STORE_PARENT_DISTANCE
+	bool storeParentDistance = true;
+#else
+	bool storeParentDistance = false;
+#endif
+
+	if (entry->leafkey) {
+		MT_MAKE_NAME(check_options)(fcinfo);
+#ifdef MT_NOT_METRIC
+		if (mtree_pivot_count(fcinfo) > 0) {
+			ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("The distance of this type is not a metric, so it does not support pivots!"));
+		}
+#else
+		MtreePivots* pivots = (MtreePivots*)fcinfo->flinfo->fn_extra;
+		if (pivots == NULL) {
+			pivots = mtree_pivots_get(fcinfo, MT_INPUT);
+			fcinfo->flinfo->fn_extra = pivots;
+		}
+
+		int sketchDimensions = 0;
+		int sketchCount = 0;
+#ifdef MT_VECTOR_ELEMENT
+		sketchCount = mtree_sketch_count(fcinfo, &sketchDimensions);
+#endif
+		if (pivots->count + sketchCount > 0) {
+			key = MT_MAKE_NAME(attach_rings)(key, pivots, sketchCount, sketchDimensions);
+		}
+#endif
+	}
+
+	MtreeQuantization* quantization = NULL;
+#ifdef MT_QUANTIZE
+	MtreeQuantization centerQuantization;
+	if (!entry->leafkey && PG_HAS_OPCLASS_OPTIONS() && ((MtreeOptions*)PG_GET_OPCLASS_OPTIONS())->quantize) {
+		MT_TYPE* quantized = MT_MAKE_NAME(quantize)(key, &centerQuantization);
+		if (quantized != NULL) {
+			key = quantized;
+			quantization = &centerQuantization;
+		}
+	}
+#endif
+
+	key = (MT_TYPE*)mtree_key_compact(key, &MT_MAKE_NAME(layout), entry->leafkey, storeParentDistance, quantization);
+	gistentryinit(*retval, PointerGetDatum(key), entry->rel, entry->page, entry->offset, false);
+
+	PG_RETURN_POINTER(retval);
+}
+
+Datum MT_MAKE_NAME(decompress)(PG_FUNCTION_ARGS)
+{
+	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	GISTENTRY* retval = (GISTENTRY*)palloc(sizeof(GISTENTRY));
+
+	gistentryinit(*retval, PointerGetDatum(MT_MAKE_NAME(expand_key)(entry->key)), entry->rel, entry->page,
+				  entry->offset, entry->leafkey);
+
+	PG_RETURN_POINTER(retval);
+}
+
+/*
+ * Reconstructs the indexed value of a leaf key for index-only scans: the full
+ * form of the stored key without the rings that compress attached to it.
+ */
+Datum MT_MAKE_NAME(fetch)(PG_FUNCTION_ARGS)
+{
+	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	MT_TYPE* value = MT_MAKE_NAME(expand_key)(entry->key);
+	GISTENTRY* retval = (GISTENTRY*)palloc(sizeof(GISTENTRY));
+
+	SET_VARSIZE(value, VARSIZE_ANY(value) - MT_MAKE_NAME(ring_count)(fcinfo) * sizeof(MtreeRing));
+
+	gistentryinit(*retval, PointerGetDatum(value), entry->rel, entry->page, entry->offset, false);
+
+	PG_RETURN_POINTER(retval);
+}
+
+Datum MT_MAKE_NAME(union)(PG_FUNCTION_ARGS)
+{
+	GistEntryVector* entryVector = (GistEntryVector*)PG_GETARG_POINTER(0);
+	GISTENTRY* entry = entryVector->vector;
+	int ranges = entryVector->n;
+
+	MT_TYPE* entries[ranges];
+	for (int i = 0; i < ranges; ++i) {
+		entries[i] = MT_DATUM_GET(entry[i].key);
+	}
+
+	MtreeUnionStrategy unionStrategy = MinMaxDistance;
+	if (PG_HAS_OPCLASS_OPTIONS()) {
+		MtreeOptions* options = (MtreeOptions*)PG_GET_OPCLASS_OPTIONS();
+		unionStrategy = options->union_strategy;
+	}
+
+#ifndef MT_NOT_METRIC
+	int ringCount = MT_MAKE_NAME(ring_count)(fcinfo);
+#endif
+
+#ifdef MT_VECTOR_ELEMENT
+	if (unionStrategy == MinimumEnclosingBall) {
+		MT_TYPE* out = MT_MAKE_NAME(enclosing_ball)(entries, ranges, ringCount);
+		MT_MAKE_NAME(union_rings)(out, ringCount, entries, ranges);
+		PG_RETURN_POINTER(out);
+	}
+#endif
+
+	int minimumIndex = 0;
+	double minimumRadius = MT_MAKE_NAME(covering_radius)(entries, ranges, 0, INFINITY);
+
+	switch (unionStrategy) {
+		case First:
+			break;
+		case MinMaxDistance:
+		case MinimumEnclosingBall:
+			for (int i = 1; i < ranges; ++i) {
+				double coveringRadius = MT_MAKE_NAME(covering_radius)(entries, ranges, i, minimumRadius);
+				if (coveringRadius < minimumRadius) {
+					minimumRadius = coveringRadius;
+					minimumIndex = i;
+				}
+			}
+			break;
+		default:
+			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
+					errmsg("Invalid StrategyNumber for union function: %u", unionStrategy));
+			break;
+	}
+
+	MT_TYPE* out = MT_DEEP_COPY(entries[minimumIndex]);
+	out->coveringRadius = minimumRadius;
+	out->parentDistance = MT_REFERENCE_DISTANCE(out);
+#ifndef MT_NOT_METRIC
+	MT_MAKE_NAME(union_rings)(out, ringCount, entries, ranges);
+#endif
+
+	PG_RETURN_POINTER(out);
+}
+
+/*
+ * M-tree subtree choice encoded in a single penalty. Subtrees whose ball
+ * already covers the new entry get a penalty in [0, 1) growing with the
+ * distance from their routing entry, so the nearest one wins. The others get
+ * 1 plus the enlargement of their radius. A zero penalty still means a
+ * perfect fit, which lets gistchoose stop early.
+ */
+Datum MT_MAKE_NAME(penalty)(PG_FUNCTION_ARGS)
+{
+	GISTENTRY* originalEntry = (GISTENTRY*)PG_GETARG_POINTER(0);
+	GISTENTRY* newEntry = (GISTENTRY*)PG_GETARG_POINTER(1);
+	float* penalty = (float*)PG_GETARG_POINTER(2);
+	MT_TYPE* original = MT_DATUM_GET(originalEntry->key);
+	MT_TYPE* new = MT_DATUM_GET(newEntry->key);
+
+	double distance = MT_FULL_DISTANCE(original, new);
+	double enlargement = distance + new->coveringRadius - original->coveringRadius;
+
+	if (enlargement <= 0.0) {
+		*penalty = MIN_2((float)(distance / (1.0 + distance)), nextafterf(1.0f, 0.0f));
+	} else {
+		*penalty = (float)(1.0 + enlargement);
+	}
+
+	PG_RETURN_POINTER(penalty);
+}
+
+Datum MT_MAKE_NAME(picksplit)(PG_FUNCTION_ARGS)
+{
+	GistEntryVector* entryVector = (GistEntryVector*)PG_GETARG_POINTER(0);
+	GIST_SPLITVEC* vector = (GIST_SPLITVEC*)PG_GETARG_POINTER(1);
+	OffsetNumber maxOffset = (OffsetNumber)entryVector->n - 1;
+	OffsetNumber numberBytes = (OffsetNumber)(maxOffset + 1) * sizeof(OffsetNumber);
+	OffsetNumber* left;
+	OffsetNumber* right;
+
+	vector->spl_left = (OffsetNumber*)palloc(numberBytes);
+	left = vector->spl_left;
+	vector->spl_nleft = 0;
+
+	vector->spl_right = (OffsetNumber*)palloc(numberBytes);
+	right = vector->spl_right;
+	vector->spl_nright = 0;
+
+	MT_TYPE* entries[maxOffset];
+
+	for (OffsetNumber i = FirstOffsetNumber; i <= maxOffset; i = OffsetNumberNext(i)) {
+		entries[i - FirstOffsetNumber] = MT_DATUM_GET(entryVector->vector[i].key);
+	}
+
+	int leftIndex = 0, rightIndex = 1, leftCandidateIndex, rightCandidateIndex;
+	double maxDistance = -1.0;
+	double minCost = -1.0;
+
+	MtreePickSplitStrategy picksplitStrategy = SamplingMinOverlapArea;
+	MtreeUnionStrategy unionStrategy = MinMaxDistance;
+	MtreeDistribution distribution = GeneralizedHyperplane;
+	int trialCount = MTREE_DEFAULT_SAMPLING_TRIALS;
+	int patience = 0;
+	int seed = 0;
+	if (PG_HAS_OPCLASS_OPTIONS()) {
+		MtreeOptions* options = (MtreeOptions*)PG_GET_OPCLASS_OPTIONS();
+		picksplitStrategy = options->picksplit_strategy;
+		unionStrategy = options->union_strategy;
+		distribution = options->distribution;
+		trialCount = options->sampling_trials;
+		patience = options->sampling_patience;
+		seed = options->random_seed;
+	}
+
+	MtreePickSplitWorkspace* workspace = mtree_picksplit_workspace_get(fcinfo, maxOffset, seed);
+
+	switch (picksplitStrategy) {
+		case Random:
+			mtree_random_pair(workspace, maxOffset, &leftIndex, &rightIndex);
+			break;
+		case FirstTwo:
+			for (int i = 0; i < maxOffset - 1; ++i) {
+				if (entries[i]->level == entries[i + 1]->level) {
+					leftIndex = i;
+					rightIndex = i + 1;
+					break;
+				}
+			}
+			break;
+		case MaxDistanceFromFirst:
+			for (int r = 1; r < maxOffset; ++r) {
+				double distance = MT_MAKE_NAME(cached_distance)(workspace, entries, 0, r);
+				if (distance > maxDistance) {
+					maxDistance = distance;
+					rightIndex = r;
+				}
+			}
+			leftIndex = 0;
+			break;
+		case MaxDistancePair:
+			for (int l = 0; l < maxOffset; ++l) {
+				for (int r = l + 1; r < maxOffset; ++r) {
+					double distance = MT_MAKE_NAME(cached_distance)(workspace, entries, l, r);
+					if (distance > maxDistance) {
+						maxDistance = distance;
+						leftIndex = l;
+						rightIndex = r;
+					}
+				}
+			}
+			break;
+		case MaxLowerBoundDistance:
+			/*
+			 * The parent distance of every key is its distance from the same
+			 * reference object, so |pd(a) - pd(b)| is a lower bound of d(a, b).
+			 * Promote the pair with the largest bound without computing any
+			 * distance.
+			 */
+			for (int i = 1; i < maxOffset; ++i) {
+				if (entries[i]->parentDistance < entries[leftIndex]->parentDistance) {
+					leftIndex = i;
+				}
+			}
+			rightIndex = leftIndex == 0 ? 1 : 0;
+			for (int i = 0; i < maxOffset; ++i) {
+				if (i != leftIndex && entries[i]->parentDistance > entries[rightIndex]->parentDistance) {
+					rightIndex = i;
+				}
+			}
+			if (leftIndex > rightIndex) {
+				int swap = leftIndex;
+				leftIndex = rightIndex;
+				rightIndex = swap;
+			}
+			break;
+		case SamplingMinCoveringSum:
+		case SamplingMinCoveringMax:
+		case SamplingMinOverlapArea:
+		case SamplingMinAreaSum:
+		case MinMaxRadius: {
+			/*
+			 * When the budget covers every pair, they are enumerated instead of
+			 * sampled, so that no pair is tried twice. MinMaxRadius always tries
+			 * every pair.
+			 */
+			int pairCount = maxOffset * (maxOffset - 1) / 2;
+			int trialsWithoutImprovement = 0;
+
+			if (picksplitStrategy == MinMaxRadius) {
+				trialCount = pairCount;
+				patience = 0;
+			}
+
+			bool exhaustive = trialCount >= pairCount;
+
+			leftCandidateIndex = 0;
+			rightCandidateIndex = 0;
+
+			for (int i = 0; i < MIN_2(trialCount, pairCount); ++i) {
+				if (exhaustive) {
+					if (++rightCandidateIndex == maxOffset) {
+						++leftCandidateIndex;
+						rightCandidateIndex = leftCandidateIndex + 1;
+					}
+				} else {
+					mtree_random_pair(workspace, maxOffset, &leftCandidateIndex, &rightCandidateIndex);
+				}
+
+				double cost = MT_MAKE_NAME(split_cost)(picksplitStrategy, distribution, workspace, entries, maxOffset,
+													   leftCandidateIndex, rightCandidateIndex);
+				if (minCost == -1.0 || cost < minCost) {
+					minCost = cost;
+					leftIndex = leftCandidateIndex;
+					rightIndex = rightCandidateIndex;
+					trialsWithoutImprovement = 0;
+				} else if (patience > 0 && ++trialsWithoutImprovement >= patience) {
+					break;
+				}
+			}
+			break;
+		}
+		case GuttmanPolyTime:
+			for (int i = 0; i < maxOffset; ++i) {
+				for (int j = i + 1; j < maxOffset; ++j) {
+					double cost = MT_MAKE_NAME(split_cost)(SamplingMinOverlapArea, distribution, workspace, entries,
+														   maxOffset, i, j);
+					if ((minCost == -1.0 || cost < minCost) && (cost != 0.0)) {
+						minCost = cost;
+						leftIndex = i;
+						rightIndex = j;
+					}
+				}
+			}
+			break;
+		default:
+			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
+					errmsg("Invalid StrategyNumber for picksplit function: %u", picksplitStrategy));
+			break;
+	}
+
+	MT_TYPE* unionLeft = MT_DEEP_COPY(entries[leftIndex]);
+	MT_TYPE* unionRight = MT_DEEP_COPY(entries[rightIndex]);
+	unionLeft->parentDistance = MT_REFERENCE_DISTANCE(unionLeft);
+	unionRight->parentDistance = MT_REFERENCE_DISTANCE(unionRight);
+
+	bool toLeft[maxOffset];
+	double leftRadius, rightRadius;
+
+	MT_MAKE_NAME(distribute)(distribution, workspace, entries, maxOffset, leftIndex, rightIndex, toLeft, &leftRadius,
+							 &rightRadius);
+	unionLeft->coveringRadius = leftRadius;
+	unionRight->coveringRadius = rightRadius;
+
+	for (OffsetNumber i = FirstOffsetNumber; i <= maxOffset; i = OffsetNumberNext(i)) {
+		if (toLeft[i - FirstOffsetNumber]) {
+			*left = i;
+			++left;
+			++(vector->spl_nleft);
+		} else {
+			*right = i;
+			++right;
+			++(vector->spl_nright);
+		}
+	}
+
+#ifndef MT_NOT_METRIC
+	MT_TYPE* leftEntries[maxOffset];
+	MT_TYPE* rightEntries[maxOffset];
+	int leftCount = 0, rightCount = 0;
+	int ringCount = MT_MAKE_NAME(ring_count)(fcinfo);
+
+	for (int i = 0; i < maxOffset; ++i) {
+		if (toLeft[i]) {
+			leftEntries[leftCount++] = entries[i];
+		} else {
+			rightEntries[rightCount++] = entries[i];
+		}
+	}
+
+#ifdef MT_VECTOR_ELEMENT
+	if (unionStrategy == MinimumEnclosingBall) {
+		if (leftCount > 0) {
+			MT_TYPE* ball = MT_MAKE_NAME(enclosing_ball)(leftEntries, leftCount, ringCount);
+			if (ball->coveringRadius < unionLeft->coveringRadius) {
+				unionLeft = ball;
+			}
+		}
+		if (rightCount > 0) {
+			MT_TYPE* ball = MT_MAKE_NAME(enclosing_ball)(rightEntries, rightCount, ringCount);
+			if (ball->coveringRadius < unionRight->coveringRadius) {
+				unionRight = ball;
+			}
+		}
+	}
+#endif
+
+	MT_MAKE_NAME(union_rings)(unionLeft, ringCount, leftEntries, leftCount);
+	MT_MAKE_NAME(union_rings)(unionRight, ringCount, rightEntries, rightCount);
+#endif
+	(void)unionStrategy;
+
+	vector->spl_ldatum = PointerGetDatum(unionLeft);
+	vector->spl_rdatum = PointerGetDatum(unionRight);
+
+	PG_RETURN_POINTER(vector);
+}
+
+#undef MT_TYPE
+#undef MT_PREFIX
+#undef MT_DATUM_GET
+#undef MT_VECTOR_ELEMENT
+#undef MT_NOT_METRIC
+#undef MT_MAKE_PREFIX
+#undef MT_MAKE_NAME
+#undef MT_MAKE_NAME_
+#undef MT_FULL_DISTANCE
+#undef MT_REFERENCE_DISTANCE
+#undef MT_DEEP_COPY
+#undef MT_EQUALS
+#undef MT_PREPARE_QUERY
+#undef MT_QUERY_DISTANCE
+#undef MT_SHARE_DISTANCE
+#undef MT_QUERY_CONVERTER
+#undef MT_STORE_PARENT_DISTANCE
+#undef MT_PADDING
+#undef MT_QUANTIZE
+#undef MT_INPUT
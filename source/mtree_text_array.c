@@ -5,7 +5,10 @@
 #include "mtree_text_array.h"
 
 #include "mtree_text_array_util.h"
+#include "mtree_sort.h"
 #include "mtree_util.h"
+#include "catalog/pg_type.h"
+#include "libpq/pqformat.h"
 
 /*
  * Data type related functions (I/O)
@@ -13,15 +16,20 @@
 
 PG_FUNCTION_INFO_V1(mtree_text_array_input);
 PG_FUNCTION_INFO_V1(mtree_text_array_output);
+PG_FUNCTION_INFO_V1(mtree_text_array_recv);
+PG_FUNCTION_INFO_V1(mtree_text_array_send);
+PG_FUNCTION_INFO_V1(mtree_text_array_from_text);
 PG_FUNCTION_INFO_V1(mtree_text_array_consistent);
 PG_FUNCTION_INFO_V1(mtree_text_array_union);
 
 PG_FUNCTION_INFO_V1(mtree_text_array_compress);
 PG_FUNCTION_INFO_V1(mtree_text_array_decompress);
+PG_FUNCTION_INFO_V1(mtree_text_array_fetch);
 PG_FUNCTION_INFO_V1(mtree_text_array_same);
 
 PG_FUNCTION_INFO_V1(mtree_text_array_penalty);
 PG_FUNCTION_INFO_V1(mtree_text_array_picksplit);
+PG_FUNCTION_INFO_V1(mtree_text_array_sortsupport);
 PG_FUNCTION_INFO_V1(mtree_text_array_distance);
 
 PG_FUNCTION_INFO_V1(mtree_text_array_overlap_operator);
@@ -29,6 +37,9 @@ PG_FUNCTION_INFO_V1(mtree_text_array_same_operator);
 PG_FUNCTION_INFO_V1(mtree_text_array_contains_operator);
 PG_FUNCTION_INFO_V1(mtree_text_array_contained_operator);
 PG_FUNCTION_INFO_V1(mtree_text_array_distance_operator);
+PG_FUNCTION_INFO_V1(mtree_text_array_radius);
+PG_FUNCTION_INFO_V1(mtree_text_array_native_contains_operator);
+PG_FUNCTION_INFO_V1(mtree_text_array_native_distance_operator);
 
 Datum mtree_text_array_input(PG_FUNCTION_ARGS)
 {
@@ -43,15 +54,15 @@ Datum mtree_text_array_input(PG_FUNCTION_ARGS)
 
 	size_t size = MTREE_TEXT_ARRAY_SIZE + arrayLength * MTREE_TEXT_ARRAY_MAX_STRINGLENGTH * sizeof(char) + 1;
 	elog(INFO, "Text array size: %ld, size variable %ld", MTREE_TEXT_ARRAY_SIZE, size);
-	mtree_text_array* result = (mtree_text_array*)palloc(size);
+	mtree_text_array* result = (mtree_text_array*)palloc0(size);
 
 	char* arrayElement = strtok(input, ",");
 	for (unsigned char i = 0; i < arrayLength; ++i) {
 		size_t arrayElementLength = strlen(arrayElement);
-		if (arrayElementLength > MTREE_TEXT_ARRAY_MAX_STRINGLENGTH) {
+		if (arrayElementLength >= MTREE_TEXT_ARRAY_MAX_STRINGLENGTH) {
 			ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 					errmsg("Every element of the input array should me maximum of %d characters long!",
-						   MTREE_TEXT_ARRAY_MAX_STRINGLENGTH));
+						   MTREE_TEXT_ARRAY_MAX_STRINGLENGTH - 1));
 		}
 
 		strcpy(result->data[i], arrayElement);
@@ -61,7 +72,8 @@ Datum mtree_text_array_input(PG_FUNCTION_ARGS)
 
 	result->arrayLength = arrayLength;
 	result->coveringRadius = 0.0;
-	result->parentDistance = 0.0;
+	result->level = 0;
+	result->parentDistance = mtree_text_array_reference_distance(result);
 
 	SET_VARSIZE(result, size);
 
@@ -94,398 +106,191 @@ Datum mtree_text_array_output(PG_FUNCTION_ARGS)
 	PG_RETURN_CSTRING(stringInfo.data);
 }
 
-Datum mtree_text_array_consistent(PG_FUNCTION_ARGS)
+/*
+ * Binary format: the header of mtree_send_header, the number of strings and
+ * every string preceded by its length in bytes.
+ */
+Datum mtree_text_array_recv(PG_FUNCTION_ARGS)
 {
-	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
-	mtree_text_array* query = PG_GETARG_MTREE_TEXT_ARRAY_P(1);
-	StrategyNumber strategyNumber = (StrategyNumber)PG_GETARG_UINT16(2);
-	bool* recheck = (bool*)PG_GETARG_POINTER(4);
-	mtree_text_array* key = DatumGetMtreeTextArray(entry->key);
-
-	*recheck = false;
-
-	bool returnValue;
-	if (GIST_LEAF(entry)) {
-		switch (strategyNumber) {
-			case GIST_SN_SAME:
-				returnValue = mtree_text_array_equals(key, query);
-				break;
-			case GIST_SN_OVERLAPS:
-				returnValue = mtree_text_array_overlap_distance(key, query);
-				break;
-			case GIST_SN_CONTAINS:
-				returnValue = mtree_text_array_contains_distance(key, query);
-				break;
-			case GIST_SN_CONTAINED_BY:
-				returnValue = mtree_text_array_contained_distance(key, query);
-				break;
-			default:
-				ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-						errmsg("Invalid StrategyNumber for consistent function: %u", strategyNumber));
-				break;
+	StringInfo buffer = (StringInfo)PG_GETARG_POINTER(0);
+	int level;
+	double coveringRadius;
+
+	mtree_receive_header(buffer, &level, &coveringRadius);
+
+	int arrayLength = mtree_receive_length(buffer, 1, UCHAR_MAX, sizeof(int32));
+	size_t size = MTREE_TEXT_ARRAY_SIZE + arrayLength * MTREE_TEXT_ARRAY_MAX_STRINGLENGTH * sizeof(char) + 1;
+	mtree_text_array* result = (mtree_text_array*)palloc0(size);
+
+	for (int i = 0; i < arrayLength; ++i) {
+		int elementLength = (int)pq_getmsgint(buffer, 4);
+		int stringLength;
+
+		if (elementLength < 0) {
+			ereport(ERROR, errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					errmsg("Invalid string length %d in binary input!", elementLength));
 		}
-	} else {
-		switch (strategyNumber) {
-			case GIST_SN_SAME:
-				returnValue = mtree_text_array_contains_distance(key, query);
-				break;
-			case GIST_SN_OVERLAPS:
-				returnValue = mtree_text_array_overlap_distance(key, query);
-				break;
-			case GIST_SN_CONTAINS:
-				returnValue = mtree_text_array_contains_distance(key, query);
-				break;
-			case GIST_SN_CONTAINED_BY:
-				returnValue = mtree_text_array_overlap_distance(key, query);
-				break;
-			default:
-				ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-						errmsg("Invalid StrategyNumber for consistent function: %u", strategyNumber));
-				break;
+
+		char* string = pq_getmsgtext(buffer, elementLength, &stringLength);
+		if (stringLength >= MTREE_TEXT_ARRAY_MAX_STRINGLENGTH) {
+			ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("Every element of the input array should me maximum of %d characters long!",
+						   MTREE_TEXT_ARRAY_MAX_STRINGLENGTH - 1));
 		}
+
+		memcpy(result->data[i], string, stringLength);
+		pfree(string);
 	}
 
-	PG_RETURN_BOOL(returnValue);
+	result->arrayLength = arrayLength;
+	result->coveringRadius = coveringRadius;
+	result->level = level;
+	result->parentDistance = mtree_text_array_reference_distance(result);
+
+	SET_VARSIZE(result, size);
+
+	PG_RETURN_POINTER(result);
 }
 
-Datum mtree_text_array_union(PG_FUNCTION_ARGS)
+Datum mtree_text_array_send(PG_FUNCTION_ARGS)
+{
+	mtree_text_array* value = PG_GETARG_MTREE_TEXT_ARRAY_P(0);
+	StringInfoData buffer;
+
+	pq_begintypsend(&buffer);
+	mtree_send_header(&buffer, value->level, value->coveringRadius);
+	pq_sendint32(&buffer, (uint32)value->arrayLength);
+	for (int i = 0; i < value->arrayLength; ++i) {
+		pq_sendcountedtext(&buffer, value->data[i], strnlen(value->data[i], MTREE_TEXT_ARRAY_MAX_STRINGLENGTH),
+						   false);
+	}
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buffer));
+}
+
+/*
+ * Cast from text[], copying the strings without going through the text
+ * representation. The strings can't contain commas, so that the value can be
+ * read back from its output.
+ */
+Datum mtree_text_array_from_text(PG_FUNCTION_ARGS)
 {
-	GistEntryVector* entryVector = (GistEntryVector*)PG_GETARG_POINTER(0);
-	GISTENTRY* entry = entryVector->vector;
-	int ranges = entryVector->n;
+	ArrayType* array = PG_GETARG_ARRAYTYPE_P(0);
+	int arrayLength = mtree_native_array_length(array);
+	Datum* elements;
 
-	mtree_text_array* entries[ranges];
-	for (int i = 0; i < ranges; ++i) {
-		entries[i] = DatumGetMtreeTextArray(entry[i].key);
+	if (arrayLength > UCHAR_MAX) {
+		ereport(ERROR, errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				errmsg("The array can contain at most %d strings!", UCHAR_MAX));
 	}
 
-	/*int searchRange = ranges;
-	float coveringRadii[searchRange];
+	deconstruct_array(array, TEXTOID, -1, false, TYPALIGN_INT, &elements, NULL, &arrayLength);
 
-	for (int i = 0; i < searchRange; ++i) {
-		coveringRadii[i] = 0.0;
+	size_t size = MTREE_TEXT_ARRAY_SIZE + arrayLength * MTREE_TEXT_ARRAY_MAX_STRINGLENGTH * sizeof(char) + 1;
+	mtree_text_array* result = (mtree_text_array*)palloc0(size);
 
-		for (int j = 0; j < ranges; ++j) {
-			float distance = mtree_text_array_distance_internal(entries[i], entries[j]);
-			float newCoveringRadius = distance + entries[j]->coveringRadius;
+	for (int i = 0; i < arrayLength; ++i) {
+		text* element = DatumGetTextPP(elements[i]);
+		size_t elementLength = VARSIZE_ANY_EXHDR(element);
 
-			if (coveringRadii[i] < newCoveringRadius) {
-				coveringRadii[i] = newCoveringRadius;
-			}
+		if (elementLength >= MTREE_TEXT_ARRAY_MAX_STRINGLENGTH) {
+			ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("Every element of the input array should me maximum of %d characters long!",
+						   MTREE_TEXT_ARRAY_MAX_STRINGLENGTH - 1));
+		}
+		if (memchr(VARDATA_ANY(element), ',', elementLength) != NULL) {
+			ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("The strings can't contain commas!"));
 		}
-	}
 
-	int minimumIndex = 0;
+		memcpy(result->data[i], VARDATA_ANY(element), elementLength);
+	}
 
-	for (int i = 1; i < searchRange; ++i) {
-		if (coveringRadii[i] < coveringRadii[minimumIndex]) {
-			minimumIndex = i;
-		}
-	}*/
+	result->arrayLength = arrayLength;
+	result->parentDistance = mtree_text_array_reference_distance(result);
 
-	// mtree_text_array* out = mtree_text_array_deep_copy(entries[minimumIndex]);
-	// out->coveringRadius = coveringRadii[minimumIndex];
+	SET_VARSIZE(result, size);
 
-	mtree_text_array* out = mtree_text_array_deep_copy(entries[0]);
-	out->coveringRadius += mtree_text_array_outer_distance(entries[0], entries[1]);
+	PG_RETURN_POINTER(result);
+}
 
-	PG_RETURN_MTREE_TEXT_ARRAY_P(out);
+/*
+ * Returns the cast of a native array type to mtree_text_array, or NULL.
+ */
+static PGFunction mtree_text_array_query_converter(Oid type)
+{
+	return type == TEXTARRAYOID ? mtree_text_array_from_text : NULL;
 }
 
+#define MT_TYPE mtree_text_array
+#define MT_PREFIX mtree_text_array
+#define MT_NOT_METRIC
+#define MT_PREPARE_QUERY mtree_text_array_prepare_query
+#define MT_QUERY_DISTANCE mtree_text_array_query_distance
+#define MT_SHARE_DISTANCE
+#define MT_QUERY_CONVERTER mtree_text_array_query_converter
+#define MT_DATUM_GET DatumGetMtreeTextArray
+#define MT_PADDING padding
+#include "mtree_template.h"
+
 Datum mtree_text_array_same(PG_FUNCTION_ARGS)
 {
 	mtree_text_array* first = PG_GETARG_MTREE_TEXT_ARRAY_P(0);
 	mtree_text_array* second = PG_GETARG_MTREE_TEXT_ARRAY_P(1);
-	PG_RETURN_BOOL(mtree_text_array_equals(first, second));
+	bool* result = (bool*)PG_GETARG_POINTER(2);
+
+	*result = mtree_key_identical(first, second);
+	PG_RETURN_POINTER(result);
 }
 
-Datum mtree_text_array_penalty(PG_FUNCTION_ARGS)
+/*
+ * The sorted build sorts stored keys.
+ */
+static double mtree_text_array_datum_distance(Datum first, Datum second)
 {
-	GISTENTRY* originalEntry = (GISTENTRY*)PG_GETARG_POINTER(0);
-	GISTENTRY* newEntry = (GISTENTRY*)PG_GETARG_POINTER(1);
-	float* penalty = (float*)PG_GETARG_POINTER(2);
-	mtree_text_array* original = DatumGetMtreeTextArray(originalEntry->key);
-	mtree_text_array* new = DatumGetMtreeTextArray(newEntry->key);
+	mtree_text_array* firstKey = mtree_text_array_expand_key(first);
+	mtree_text_array* secondKey = mtree_text_array_expand_key(second);
+	double distance = mtree_text_array_full_distance(firstKey, secondKey);
 
-	double distance = mtree_text_array_outer_distance(original, new);
-	*penalty = distance;
+	pfree(firstKey);
+	pfree(secondKey);
 
-	PG_RETURN_POINTER(penalty);
+	return distance;
 }
 
-Datum mtree_text_array_picksplit(PG_FUNCTION_ARGS)
+Datum mtree_text_array_sortsupport(PG_FUNCTION_ARGS)
 {
-	GistEntryVector* entryVector = (GistEntryVector*)PG_GETARG_POINTER(0);
-	GIST_SPLITVEC* vector = (GIST_SPLITVEC*)PG_GETARG_POINTER(1);
-	OffsetNumber maxOffset = (OffsetNumber)entryVector->n - 1;
-	OffsetNumber numberBytes = (OffsetNumber)(maxOffset + 1) * sizeof(OffsetNumber);
-	OffsetNumber *left, *right;
-
-	vector->spl_left = (OffsetNumber*)palloc(numberBytes);
-	left = vector->spl_left;
-	vector->spl_nleft = 0;
-
-	vector->spl_right = (OffsetNumber*)palloc(numberBytes);
-	right = vector->spl_right;
-	vector->spl_nright = 0;
-
-	mtree_text_array* entries[maxOffset];
-	for (OffsetNumber i = FirstOffsetNumber; i <= maxOffset; i = OffsetNumberNext(i)) {
-		entries[i - FirstOffsetNumber] = DatumGetMtreeTextArray(entryVector->vector[i].key);
-	}
+	SortSupport ssup = (SortSupport)PG_GETARG_POINTER(0);
 
-	double distances[maxOffset][maxOffset];
-	init_distances(maxOffset, *distances);
-
-	int leftIndex, rightIndex, leftCandidateIndex, rightCandidateIndex;
-	int trialCount = 100;
-	double maxDistance = -1.0;
-	double minCoveringSum = -1.0;
-	double minCoveringMax = -1.0;
-	double minOverlapArea = -1.0;
-	double minSumArea = -1.0;
-
-	MtreePickSplitStrategy picksplit_strategy = SamplingMinOverlapArea;
-	if (PG_HAS_OPCLASS_OPTIONS()) {
-		MtreeOptions* options = (MtreeOptions*)PG_GET_OPCLASS_OPTIONS();
-		picksplit_strategy = options->picksplit_strategy;
-	}
-
-	switch (picksplit_strategy) {
-		case Random:
-			leftIndex = ((int)random()) % (maxOffset - 1);
-			rightIndex = (leftIndex + 1) + (((int)random()) % (maxOffset - leftIndex - 1));
-			break;
-		case FirstTwo:
-			leftIndex = -1;
-			rightIndex = -1;
-
-			for (int i = 0; i < maxOffset - 1; ++i) {
-				if (entries[i]->level == entries[i + 1]->level) {
-					leftIndex = i;
-					rightIndex = i + 1;
-					break;
-				}
-			}
-
-			break;
-		case MaxDistanceFromFirst:
-			maxDistance = -1;
-			for (int r = 0; r < maxOffset; ++r) {
-				double distance = get_text_array_distance(maxOffset, entries, distances, 0, r);
-				if (distance > maxDistance) {
-					maxDistance = distance;
-					rightCandidateIndex = r;
-				}
-			}
-			leftIndex = 0;
-			rightIndex = rightCandidateIndex;
-			break;
-		case MaxDistancePair:
-			for (OffsetNumber l = 0; l < maxOffset; ++l) {
-				for (OffsetNumber r = l; r < maxOffset; ++r) {
-					double distance = get_text_array_distance(maxOffset, entries, distances, l, r);
-					if (distance > maxDistance) {
-						maxDistance = distance;
-						leftCandidateIndex = l;
-						rightCandidateIndex = r;
-					}
-				}
-			}
-			leftIndex = leftCandidateIndex;
-			rightIndex = rightCandidateIndex;
-			break;
-		case SamplingMinCoveringSum:
-			for (int i = 0; i < trialCount; ++i) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; currentIndex++) {
-					double distanceLeft =
-						get_text_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_text_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				if (minCoveringSum == -1.0 || leftRadius + rightRadius < minCoveringSum) {
-					minCoveringSum = leftRadius + rightRadius;
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		case SamplingMinCoveringMax:
-			for (int i = 0; i < trialCount; ++i) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; ++currentIndex) {
-					double distanceLeft =
-						get_text_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_text_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				if (minCoveringMax == -1.0 || MAX_2(leftRadius, rightRadius) < minCoveringMax) {
-					minCoveringMax = MAX_2(leftRadius, rightRadius);
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		case SamplingMinOverlapArea:
-			for (int i = 0; i < trialCount; i++) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double distance =
-					get_text_array_distance(maxOffset, entries, distances, leftCandidateIndex, rightCandidateIndex);
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; currentIndex++) {
-					double distanceLeft =
-						get_text_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_text_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				double currentOverlapArea = overlap_area(leftRadius, rightRadius, distance);
-				if (minOverlapArea == -1.0 || currentOverlapArea < minOverlapArea) {
-					minOverlapArea = currentOverlapArea;
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		case SamplingMinAreaSum:
-			for (int i = 0; i < trialCount; i++) {
-				leftCandidateIndex = ((int)random()) % (maxOffset - 1);
-				rightCandidateIndex =
-					(leftCandidateIndex + 1) + (((int)random()) % (maxOffset - leftCandidateIndex - 1));
-				double leftRadius = 0.0, rightRadius = 0.0;
-
-				for (int currentIndex = 0; currentIndex < maxOffset; currentIndex++) {
-					double distanceLeft =
-						get_text_array_distance(maxOffset, entries, distances, leftCandidateIndex, currentIndex);
-					double distanceRight =
-						get_text_array_distance(maxOffset, entries, distances, rightCandidateIndex, currentIndex);
-
-					if (distanceLeft < distanceRight) {
-						if (distanceLeft + entries[currentIndex]->coveringRadius > leftRadius) {
-							leftRadius = distanceLeft + entries[currentIndex]->coveringRadius;
-						}
-					} else {
-						if (distanceRight + entries[currentIndex]->coveringRadius > rightRadius) {
-							rightRadius = distanceRight + entries[currentIndex]->coveringRadius;
-						}
-					}
-				}
-
-				double currentSumArea = leftRadius * leftRadius + rightRadius * rightRadius;
-				if (minSumArea == -1.0 || currentSumArea < minSumArea) {
-					minSumArea = currentSumArea;
-					leftIndex = leftCandidateIndex;
-					rightIndex = rightCandidateIndex;
-				}
-			}
-			break;
-		default:
-			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
-					errmsg("Invalid strategy for mtree_text_array_picksplit: %hu", picksplit_strategy));
-			break;
-	}
-
-	mtree_text_array* unionLeft = mtree_text_array_deep_copy(entries[leftIndex]);
-	mtree_text_array* unionRight = mtree_text_array_deep_copy(entries[rightIndex]);
-	mtree_text_array* current;
-
-	for (OffsetNumber i = FirstOffsetNumber; i <= maxOffset; i = OffsetNumberNext(i)) {
-		double distanceLeft = get_text_array_distance(maxOffset, entries, distances, leftIndex, i - 1);
-		double distanceRight = get_text_array_distance(maxOffset, entries, distances, rightIndex, i - 1);
-		current = entries[i - 1];
-
-		if (distanceLeft < distanceRight) {
-			if (distanceLeft + current->coveringRadius > unionLeft->coveringRadius) {
-				unionLeft->coveringRadius = distanceLeft + current->coveringRadius;
-			}
-			*left = i;
-			++left;
-			++(vector->spl_nleft);
-		} else {
-			if (distanceRight + current->coveringRadius > unionRight->coveringRadius) {
-				unionRight->coveringRadius = distanceRight + current->coveringRadius;
-			}
-			*right = i;
-			++right;
-			++(vector->spl_nright);
-		}
-	}
+	mtree_pivot_sortsupport(ssup, mtree_text_array_datum_distance);
 
-	vector->spl_ldatum = PointerGetDatum(unionLeft);
-	vector->spl_rdatum = PointerGetDatum(unionRight);
-
-	PG_RETURN_POINTER(vector);
+	PG_RETURN_VOID();
 }
 
-Datum mtree_text_array_compress(PG_FUNCTION_ARGS)
+Datum mtree_text_array_distance_operator(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_POINTER(PG_GETARG_POINTER(0));
-}
+	mtree_text_array* first = PG_GETARG_MTREE_TEXT_ARRAY_P(0);
+	mtree_text_array* second = PG_GETARG_MTREE_TEXT_ARRAY_P(1);
 
-Datum mtree_text_array_decompress(PG_FUNCTION_ARGS)
-{
-	PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	PG_RETURN_FLOAT8((float8)mtree_text_array_outer_distance(first, second));
 }
 
-Datum mtree_text_array_distance(PG_FUNCTION_ARGS)
+/*
+ * Returns a copy of the object with the given covering radius, so that
+ * x #<# mtree_ball(q, r) is an indexed range query.
+ */
+Datum mtree_text_array_radius(PG_FUNCTION_ARGS)
 {
-	GISTENTRY* entry = (GISTENTRY*)PG_GETARG_POINTER(0);
-	mtree_text_array* query = PG_GETARG_MTREE_TEXT_ARRAY_P(1);
-	mtree_text_array* key = DatumGetMtreeTextArray(entry->key);
+	mtree_text_array* center = PG_GETARG_MTREE_TEXT_ARRAY_P(0);
+	float8 radius = PG_GETARG_FLOAT8(1);
 
-	PG_RETURN_FLOAT8((float8)mtree_text_array_outer_distance(query, key));
-}
+	if (!(radius >= 0.0)) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("The radius can't be negative!"));
+	}
 
-Datum mtree_text_array_distance_operator(PG_FUNCTION_ARGS)
-{
-	mtree_text_array* first = PG_GETARG_MTREE_TEXT_ARRAY_P(0);
-	mtree_text_array* second = PG_GETARG_MTREE_TEXT_ARRAY_P(1);
+	mtree_text_array* result = mtree_text_array_deep_copy(center);
+	result->coveringRadius = radius;
 
-	PG_RETURN_FLOAT8((float8)mtree_text_array_outer_distance(first, second));
+	PG_RETURN_POINTER(result);
 }
 
 Datum mtree_text_array_overlap_operator(PG_FUNCTION_ARGS)
@@ -522,3 +327,34 @@ Datum mtree_text_array_same_operator(PG_FUNCTION_ARGS)
 
 	PG_RETURN_BOOL(mtree_text_array_equals(first, second));
 }
+
+/*
+ * Cross-type operators with a text[] on the right.
+ */
+static mtree_text_array* mtree_text_array_native_argument(FunctionCallInfo fcinfo, int argument)
+{
+	PGFunction convert = mtree_text_array_query_converter(get_fn_expr_argtype(fcinfo->flinfo, argument));
+
+	if (convert == NULL) {
+		ereport(ERROR, errcode(ERRCODE_DATATYPE_MISMATCH), errmsg("The argument has to be a text[]!"));
+	}
+
+	return DatumGetMtreeTextArray(DirectFunctionCall1(convert, PG_GETARG_DATUM(argument)));
+}
+
+Datum mtree_text_array_native_contains_operator(PG_FUNCTION_ARGS)
+{
+	mtree_text_array* first = PG_GETARG_MTREE_TEXT_ARRAY_P(0);
+	mtree_text_array* second = mtree_text_array_native_argument(fcinfo, 1);
+	bool result = mtree_text_array_contains_distance(first, second);
+
+	PG_RETURN_BOOL(result);
+}
+
+Datum mtree_text_array_native_distance_operator(PG_FUNCTION_ARGS)
+{
+	mtree_text_array* first = PG_GETARG_MTREE_TEXT_ARRAY_P(0);
+	mtree_text_array* second = mtree_text_array_native_argument(fcinfo, 1);
+
+	PG_RETURN_FLOAT8((float8)mtree_text_array_outer_distance(first, second));
+}
@@ -14,11 +14,17 @@
 #define PG_RETURN_MTREE_TEXT_ARRAY_P(x)	  PG_RETURN_POINTER(x)
 
 typedef struct {
+	/* varlena header (do not touch directly!) */
+	int32 vl_len_;
+	int level;
 	double parentDistance;
 	double coveringRadius;
-	int level;
 	unsigned char arrayLength;
+	/* data starts MTREE_PAYLOAD_ALIGNMENT bytes into the key */
+	char padding[7];
 	char data[FLEXIBLE_ARRAY_MEMBER][MTREE_TEXT_ARRAY_MAX_STRINGLENGTH];
-} __attribute__((packed, aligned(1))) mtree_text_array;
+} mtree_text_array;
+
+StaticAssertDecl(offsetof(mtree_text_array, data) % MTREE_PAYLOAD_ALIGNMENT == 0, "misaligned mtree_text_array data");
 
 #endif
@@ -6,23 +6,6 @@
 
 #include "mtree_util.h"
 
-double mtree_text_array_outer_distance(mtree_text_array* first, mtree_text_array* second)
-{
-	double distance = simple_text_array_distance(first, second);
-	double outer_distance = distance - first->coveringRadius - second->coveringRadius;
-
-	if (outer_distance < 0.0) {
-		outer_distance = 0.0;
-	}
-
-	return outer_distance;
-}
-
-double mtree_text_array_full_distance(mtree_text_array* first, mtree_text_array* second)
-{
-	return simple_text_array_distance(first, second);
-}
-
 bool mtree_text_array_equals(mtree_text_array* first, mtree_text_array* second)
 {
 	if (first->arrayLength != second->arrayLength) {
@@ -62,14 +45,6 @@ mtree_text_array* mtree_text_array_deep_copy(mtree_text_array* source)
 	return destination;
 }
 
-double get_text_array_distance(int size, mtree_text_array* entries[size], double distances[size][size], int i, int j)
-{
-	if (distances[i][j] == -1) {
-		distances[i][j] = mtree_text_array_full_distance(entries[i], entries[j]);
-	}
-	return distances[i][j];
-}
-
 double simple_text_array_distance(mtree_text_array* first, mtree_text_array* second)
 {
 	double dist = 0.0;
@@ -86,6 +61,41 @@ double simple_text_array_distance(mtree_text_array* first, mtree_text_array* sec
 	return dist;
 }
 
+/*
+ * Builds the Levenshtein patterns of the elements of the query of a scan, so
+ * that simple_text_array_distance is computed with the bit-parallel
+ * algorithm.
+ */
+void* mtree_text_array_prepare_query(mtree_text_array* query)
+{
+	MtreeStringPattern* patterns =
+		(MtreeStringPattern*)palloc(MAX_2(query->arrayLength, 1) * sizeof(MtreeStringPattern));
+
+	for (unsigned char i = 0; i < query->arrayLength; ++i) {
+		mtree_string_pattern_init(&patterns[i], query->data[i]);
+	}
+
+	return patterns;
+}
+
+double mtree_text_array_query_distance(MtreeQueryCache* cache, mtree_text_array* key)
+{
+	mtree_text_array* query = (mtree_text_array*)cache->query;
+	MtreeStringPattern* patterns = (MtreeStringPattern*)cache->prepared;
+	double dist = 0.0;
+	unsigned char arrayLength = MIN_2(query->arrayLength, key->arrayLength);
+
+	for (unsigned char i = 0; i < arrayLength; ++i) {
+		if (patterns[i].length < 0) {
+			dist += string_distance(query->data[i], key->data[i]);
+		} else {
+			dist += mtree_string_pattern_distance(&patterns[i], key->data[i]);
+		}
+	}
+
+	return dist;
+}
+
 #define MIN_FLOAT(x, y) (((x) < (y)) ? (1.0 * x) : (1.0 * y))
 
 /*
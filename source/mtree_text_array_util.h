@@ -6,9 +6,7 @@
 #define __MTREE_TEXT_ARRAY_UTIL_H__
 
 #include "mtree_text_array.h"
-
-double mtree_text_array_outer_distance(mtree_text_array* first, mtree_text_array* second);
-double mtree_text_array_full_distance(mtree_text_array* first, mtree_text_array* second);
+#include "mtree_util.h"
 
 bool mtree_text_array_equals(mtree_text_array* first, mtree_text_array* second);
 bool mtree_text_array_overlap_distance(mtree_text_array* first, mtree_text_array* second);
@@ -16,7 +14,8 @@ bool mtree_text_array_contains_distance(mtree_text_array* first, mtree_text_arra
 bool mtree_text_array_contained_distance(mtree_text_array* first, mtree_text_array* second);
 
 mtree_text_array* mtree_text_array_deep_copy(mtree_text_array* source);
-double get_text_array_distance(int size, mtree_text_array* entries[size], double distances[size][size], int i, int j);
+void* mtree_text_array_prepare_query(mtree_text_array* query);
+double mtree_text_array_query_distance(MtreeQueryCache* cache, mtree_text_array* key);
 
 double simple_text_array_distance(mtree_text_array* first, mtree_text_array* second);
 double weighted_text_array_distance(mtree_text_array* first, mtree_text_array* second);
@@ -36,4 +35,32 @@ double SimED(mtree_text_array* first, mtree_text_array* second);
 
 double notCoTagsDistance(mtree_text_array* first, mtree_text_array* second);
 
+static inline double mtree_text_array_full_distance(mtree_text_array* first, mtree_text_array* second)
+{
+	return simple_text_array_distance(first, second);
+}
+
+static inline double mtree_text_array_outer_distance(mtree_text_array* first, mtree_text_array* second)
+{
+	double distance = simple_text_array_distance(first, second);
+	double outer_distance = distance - first->coveringRadius - second->coveringRadius;
+
+	if (outer_distance < 0.0) {
+		outer_distance = 0.0;
+	}
+
+	return outer_distance;
+}
+
+/*
+ * Distance from the reference object (the empty array), stored in
+ * parentDistance. The distance only compares the common prefix of two arrays,
+ * so every array is at distance zero from the empty one and the reference
+ * distance gives no lower bound for this type.
+ */
+static inline double mtree_text_array_reference_distance(mtree_text_array* key)
+{
+	return 0.0;
+}
+
 #endif
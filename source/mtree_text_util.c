@@ -6,22 +6,6 @@
 
 #include "mtree_util.h"
 
-double mtree_text_outer_distance(mtree_text* first, mtree_text* second)
-{
-	double distance = string_distance(first->vl_data, second->vl_data);
-	double outer_distance = distance - first->coveringRadius - second->coveringRadius;
-
-	if (outer_distance < 0.0) {
-		outer_distance = 0.0;
-	}
-
-	return outer_distance;
-}
-double mtree_text_full_distance(mtree_text* first, mtree_text* second)
-{
-	return string_distance(first->vl_data, second->vl_data);
-}
-
 bool mtree_text_equals(mtree_text* first, mtree_text* second)
 {
 	return strcmp(first->vl_data, second->vl_data) == 0;
@@ -44,19 +28,33 @@ bool mtree_text_contained_distance(mtree_text* first, mtree_text* second)
 	return mtree_text_contains_distance(second, first);
 }
 
-mtree_text* mtree_text_deep_copy(mtree_text* source)
+/*
+ * Builds the Levenshtein pattern of the query of a scan, so that its distance
+ * from every key is computed with the bit-parallel algorithm.
+ */
+void* mtree_text_prepare_query(mtree_text* query)
 {
-	mtree_text* destination = (mtree_text*)palloc(VARSIZE_ANY(source));
-	memcpy(destination, source, VARSIZE_ANY(source));
-	return destination;
+	MtreeStringPattern* pattern = (MtreeStringPattern*)palloc(sizeof(MtreeStringPattern));
+	mtree_string_pattern_init(pattern, query->vl_data);
+	return pattern;
 }
 
-double get_distance(int size, mtree_text* entries[size], double distances[size][size], int i, int j)
+double mtree_text_query_distance(MtreeQueryCache* cache, mtree_text* key)
 {
-	if (distances[i][j] == -1) {
-		distances[i][j] = mtree_text_full_distance(entries[i], entries[j]);
+	MtreeStringPattern* pattern = (MtreeStringPattern*)cache->prepared;
+
+	if (pattern->length < 0) {
+		return mtree_text_full_distance((mtree_text*)cache->query, key);
 	}
-	return distances[i][j];
+
+	return mtree_string_pattern_distance(pattern, key->vl_data);
+}
+
+mtree_text* mtree_text_deep_copy(mtree_text* source)
+{
+	mtree_text* destination = (mtree_text*)palloc(VARSIZE_ANY(source));
+	memcpy(destination, source, VARSIZE_ANY(source));
+	return destination;
 }
 
 bool mtree_text_overlap_wrapper(mtree_text* first, mtree_text* second)
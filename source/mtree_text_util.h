@@ -6,17 +6,43 @@
 #define __MTREE_TEXT_UTIL_H__
 
 #include "mtree_text.h"
+#include "mtree_util.h"
 
-double mtree_text_outer_distance(mtree_text* first, mtree_text* second);
-double mtree_text_full_distance(mtree_text* first, mtree_text* second);
 bool mtree_text_equals(mtree_text* first, mtree_text* second);
 bool mtree_text_overlap_distance(mtree_text* first, mtree_text* second);
 bool mtree_text_contains_distance(mtree_text* first, mtree_text* second);
 bool mtree_text_contained_distance(mtree_text* first, mtree_text* second);
 mtree_text* mtree_text_deep_copy(mtree_text* source);
-double get_distance(int size, mtree_text* entries[size], double distances[size][size], int i, int j);
 bool mtree_text_overlap_wrapper(mtree_text* first, mtree_text* second);
 bool mtree_text_contains_wrapper(mtree_text* first, mtree_text* second);
 bool mtree_text_contained_wrapper(mtree_text* first, mtree_text* second);
+void* mtree_text_prepare_query(mtree_text* query);
+double mtree_text_query_distance(MtreeQueryCache* cache, mtree_text* key);
+
+static inline double mtree_text_full_distance(mtree_text* first, mtree_text* second)
+{
+	return string_distance(first->vl_data, second->vl_data);
+}
+
+static inline double mtree_text_outer_distance(mtree_text* first, mtree_text* second)
+{
+	double distance = string_distance(first->vl_data, second->vl_data);
+	double outer_distance = distance - first->coveringRadius - second->coveringRadius;
+
+	if (outer_distance < 0.0) {
+		outer_distance = 0.0;
+	}
+
+	return outer_distance;
+}
+
+/*
+ * Distance from the reference object (the empty string), stored in
+ * parentDistance.
+ */
+static inline double mtree_text_reference_distance(mtree_text* key)
+{
+	return strlen(key->vl_data);
+}
 
 #endif
@@ -0,0 +1,202 @@
+/*
+ * contrib/mtree_gist/mtree_upgrade.c
+ *
+ * Conversion of the values stored by version 1.0 of the extension, whose
+ * types were packed structs with their fields in varying order, to the
+ * aligned layouts. Used by mtree_gist--1.0--1.1.sql only.
+ */
+
+#include "mtree_float_util.h"
+#include "mtree_float_array_util.h"
+#include "mtree_int32_util.h"
+#include "mtree_int32_array_util.h"
+#include "mtree_text_util.h"
+#include "mtree_text_array_util.h"
+
+#include "fmgr.h"
+
+PG_FUNCTION_INFO_V1(mtree_float_upgrade);
+PG_FUNCTION_INFO_V1(mtree_int32_upgrade);
+PG_FUNCTION_INFO_V1(mtree_float_array_upgrade);
+PG_FUNCTION_INFO_V1(mtree_int32_array_upgrade);
+PG_FUNCTION_INFO_V1(mtree_text_upgrade);
+PG_FUNCTION_INFO_V1(mtree_text_array_upgrade);
+
+/*
+ * The 1.0 structs, exactly as that version declared them. They had no
+ * varlena header, so SET_VARSIZE overwrote their first 4 bytes: the level of
+ * mtree_float, mtree_int32 and mtree_int32_array, and half of the
+ * parentDistance of the other types. Neither field held a value in 1.0, the
+ * conversion only reads the covering radius and the data, and computes
+ * parentDistance, the distance from the reference object of the type.
+ */
+
+typedef struct {
+	int level;
+	double parentDistance;
+	double coveringRadius;
+	float data;
+} __attribute__((packed, aligned(1))) mtree_float_1_0;
+
+typedef struct {
+	int level;
+	double parentDistance;
+	double coveringRadius;
+	int data;
+} __attribute__((packed, aligned(1))) mtree_int32_1_0;
+
+typedef struct {
+	double parentDistance;
+	double coveringRadius;
+	unsigned char arrayLength;
+	int level;
+	float data[FLEXIBLE_ARRAY_MEMBER];
+} __attribute__((packed, aligned(1))) mtree_float_array_1_0;
+
+typedef struct {
+	int level;
+	double parentDistance;
+	double coveringRadius;
+	unsigned char arrayLength;
+	int data[FLEXIBLE_ARRAY_MEMBER];
+} __attribute__((packed, aligned(1))) mtree_int32_array_1_0;
+
+typedef struct {
+	double parentDistance;
+	double coveringRadius;
+	int level;
+	char vl_length[4];
+	char vl_data[FLEXIBLE_ARRAY_MEMBER];
+} __attribute__((packed, aligned(1))) mtree_text_1_0;
+
+typedef struct {
+	double parentDistance;
+	double coveringRadius;
+	int level;
+	unsigned char arrayLength;
+	char data[FLEXIBLE_ARRAY_MEMBER][MTREE_TEXT_ARRAY_MAX_STRINGLENGTH];
+} __attribute__((packed, aligned(1))) mtree_text_array_1_0;
+
+/*
+ * Checks that a 1.0 value holds the fields the conversion reads.
+ */
+static void mtree_upgrade_check_size(void* source, Size size)
+{
+	if (VARSIZE_ANY(source) < size) {
+		ereport(ERROR, errcode(ERRCODE_DATA_CORRUPTED),
+				errmsg("The value is too short for the 1.0 layout: %zu bytes instead of at least %zu!",
+					   (Size)VARSIZE_ANY(source), size));
+	}
+}
+
+Datum mtree_float_upgrade(PG_FUNCTION_ARGS)
+{
+	mtree_float_1_0* source = (mtree_float_1_0*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+	mtree_float* result = (mtree_float*)palloc0(MTREE_FLOAT_SIZE);
+
+	mtree_upgrade_check_size(source, sizeof(mtree_float_1_0));
+
+	SET_VARSIZE(result, MTREE_FLOAT_SIZE);
+	result->coveringRadius = source->coveringRadius;
+	result->data = source->data;
+	result->parentDistance = mtree_float_reference_distance(result);
+
+	PG_RETURN_POINTER(result);
+}
+
+Datum mtree_int32_upgrade(PG_FUNCTION_ARGS)
+{
+	mtree_int32_1_0* source = (mtree_int32_1_0*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+	mtree_int32* result = (mtree_int32*)palloc0(MTREE_INT32_SIZE);
+
+	mtree_upgrade_check_size(source, sizeof(mtree_int32_1_0));
+
+	SET_VARSIZE(result, MTREE_INT32_SIZE);
+	result->coveringRadius = source->coveringRadius;
+	result->data = source->data;
+	result->parentDistance = mtree_int32_reference_distance(result);
+
+	PG_RETURN_POINTER(result);
+}
+
+Datum mtree_float_array_upgrade(PG_FUNCTION_ARGS)
+{
+	mtree_float_array_1_0* source = (mtree_float_array_1_0*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+
+	mtree_upgrade_check_size(source, sizeof(mtree_float_array_1_0));
+	mtree_upgrade_check_size(source, sizeof(mtree_float_array_1_0) + source->arrayLength * sizeof(float));
+
+	Size size = MTREE_FLOAT_ARRAY_SIZE + source->arrayLength * sizeof(float);
+	mtree_float_array* result = (mtree_float_array*)palloc0(size);
+
+	SET_VARSIZE(result, size);
+	result->coveringRadius = source->coveringRadius;
+	result->arrayLength = source->arrayLength;
+	memcpy(result->data, source->data, source->arrayLength * sizeof(float));
+	result->parentDistance = mtree_float_array_reference_distance(result);
+
+	PG_RETURN_POINTER(result);
+}
+
+Datum mtree_int32_array_upgrade(PG_FUNCTION_ARGS)
+{
+	mtree_int32_array_1_0* source = (mtree_int32_array_1_0*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+
+	mtree_upgrade_check_size(source, sizeof(mtree_int32_array_1_0));
+	mtree_upgrade_check_size(source, sizeof(mtree_int32_array_1_0) + source->arrayLength * sizeof(int));
+
+	Size size = MTREE_INT32_ARRAY_SIZE + source->arrayLength * sizeof(int);
+	mtree_int32_array* result = (mtree_int32_array*)palloc0(size);
+
+	SET_VARSIZE(result, size);
+	result->coveringRadius = source->coveringRadius;
+	result->arrayLength = source->arrayLength;
+	memcpy(result->data, source->data, source->arrayLength * sizeof(int));
+	result->parentDistance = mtree_int32_array_reference_distance(result);
+
+	PG_RETURN_POINTER(result);
+}
+
+Datum mtree_text_upgrade(PG_FUNCTION_ARGS)
+{
+	mtree_text_1_0* source = (mtree_text_1_0*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+
+	mtree_upgrade_check_size(source, sizeof(mtree_text_1_0));
+
+	Size length = strnlen(source->vl_data, VARSIZE_ANY(source) - sizeof(mtree_text_1_0));
+	Size size = MTREE_TEXT_SIZE + length + 1;
+	mtree_text* result = (mtree_text*)palloc0(size);
+
+	SET_VARSIZE(result, size);
+	result->coveringRadius = source->coveringRadius;
+	memcpy(result->vl_data, source->vl_data, length);
+	result->parentDistance = mtree_text_reference_distance(result);
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * 1.0 accepted elements of exactly MTREE_TEXT_ARRAY_MAX_STRINGLENGTH bytes,
+ * which left no room for their terminator, so they lose their last byte.
+ */
+Datum mtree_text_array_upgrade(PG_FUNCTION_ARGS)
+{
+	mtree_text_array_1_0* source = (mtree_text_array_1_0*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+
+	mtree_upgrade_check_size(source, sizeof(mtree_text_array_1_0));
+	mtree_upgrade_check_size(source,
+							 sizeof(mtree_text_array_1_0) + source->arrayLength * MTREE_TEXT_ARRAY_MAX_STRINGLENGTH);
+
+	Size size = MTREE_TEXT_ARRAY_SIZE + source->arrayLength * MTREE_TEXT_ARRAY_MAX_STRINGLENGTH + 1;
+	mtree_text_array* result = (mtree_text_array*)palloc0(size);
+
+	SET_VARSIZE(result, size);
+	result->coveringRadius = source->coveringRadius;
+	result->arrayLength = source->arrayLength;
+	for (int i = 0; i < source->arrayLength; ++i) {
+		memcpy(result->data[i], source->data[i], strnlen(source->data[i], MTREE_TEXT_ARRAY_MAX_STRINGLENGTH - 1));
+	}
+	result->parentDistance = mtree_text_array_reference_distance(result);
+
+	PG_RETURN_POINTER(result);
+}
@@ -4,7 +4,10 @@
 
 #include "mtree_util.h"
 
-#include "postgres.h"
+#include "mtree_gist.h"
+#include "libpq/pqformat.h"
+#include "miscadmin.h"
+#include "utils/memutils.h"
 
 double string_distance(const char* a, const char* b)
 {
@@ -30,13 +33,888 @@ double string_distance(const char* a, const char* b)
 	return column[lengthOfA];
 }
 
-void init_distances(const int size, double* distances)
+/*
+ * Computes the positions of every byte value in a string for
+ * mtree_string_pattern_distance.
+ */
+void mtree_string_pattern_init(MtreeStringPattern* pattern, const char* string)
+{
+	size_t length = strlen(string);
+
+	memset(pattern, 0, sizeof(MtreeStringPattern));
+
+	if (length > MTREE_STRING_PATTERN_MAX_LENGTH) {
+		pattern->length = -1;
+		return;
+	}
+
+	pattern->length = (int)length;
+	for (size_t i = 0; i < length; ++i) {
+		pattern->positions[(unsigned char)string[i]] |= (uint64)1 << i;
+	}
+}
+
+/*
+ * Levenshtein distance between the string of a pattern and another string,
+ * with the bit-parallel algorithm of Myers (as extended by Hyyrö to the edit
+ * distance of whole strings): a column of the dynamic programming matrix of
+ * string_distance is kept as vertical delta bit vectors and computed with a
+ * few word operations per byte of the other string.
+ */
+double mtree_string_pattern_distance(const MtreeStringPattern* pattern, const char* string)
+{
+	if (pattern->length == 0) {
+		return strlen(string);
+	}
+
+	uint64 positive = ~(uint64)0;
+	uint64 negative = 0;
+	uint64 last = (uint64)1 << (pattern->length - 1);
+	int distance = pattern->length;
+
+	for (const unsigned char* c = (const unsigned char*)string; *c != '\0'; ++c) {
+		uint64 match = pattern->positions[*c];
+		uint64 vertical = match | negative;
+		uint64 horizontal = (((match & positive) + positive) ^ positive) | match;
+		uint64 horizontalPositive = negative | ~(horizontal | positive);
+		uint64 horizontalNegative = positive & horizontal;
+
+		if (horizontalPositive & last) {
+			++distance;
+		} else if (horizontalNegative & last) {
+			--distance;
+		}
+
+		horizontalPositive = (horizontalPositive << 1) | 1;
+		horizontalNegative <<= 1;
+		positive = horizontalNegative | ~(vertical | horizontalPositive);
+		negative = horizontalPositive & vertical;
+	}
+
+	return distance;
+}
+
+MtreePickSplitWorkspace* mtree_picksplit_workspace_get(FunctionCallInfo fcinfo, int size, int seed)
+{
+	MtreePickSplitWorkspace* workspace = (MtreePickSplitWorkspace*)fcinfo->flinfo->fn_extra;
+	size_t cellCount = (size_t)size * (size - 1) / 2;
+
+	if (workspace == NULL) {
+		workspace =
+			(MtreePickSplitWorkspace*)MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt, sizeof(MtreePickSplitWorkspace));
+		pg_prng_seed(&workspace->random, (uint64)seed);
+		fcinfo->flinfo->fn_extra = workspace;
+	}
+
+	workspace->size = size;
+	workspace->cached = cellCount * sizeof(float4) <= (size_t)maintenance_work_mem * 1024L;
+
+	if (!workspace->cached) {
+		return workspace;
+	}
+
+	if (workspace->capacity < cellCount) {
+		if (workspace->distances != NULL) {
+			pfree(workspace->distances);
+		}
+		workspace->distances = (float4*)MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, cellCount * sizeof(float4));
+		workspace->capacity = cellCount;
+	}
+
+	/* All bits set is a NaN, which marks the distance as unknown. */
+	memset(workspace->distances, 0xFF, cellCount * sizeof(float4));
+
+	return workspace;
+}
+
+/*
+ * Compares a distance with a threshold derived from other distances, loosened
+ * for their rounding errors.
+ */
+static inline bool mtree_exceeds(double value, double threshold)
+{
+	return value > threshold + MTREE_LOWER_BOUND_TOLERANCE * (1.0 + fabs(threshold));
+}
+
+static uint64 queryGeneration = 0;
+
+/*
+ * Returns the cached state of the given query, setting isNew if the query
+ * differs from the one of the previous call and the state must be computed.
+ * The query is converted with convert unless it is NULL.
+ */
+MtreeQueryCache* mtree_query_cache_get(FunctionCallInfo fcinfo, Datum queryDatum, PGFunction convert, bool* isNew)
+{
+	MtreeQueryCache* cache = (MtreeQueryCache*)fcinfo->flinfo->fn_extra;
+	Pointer raw = DatumGetPointer(queryDatum);
+	Size rawSize = VARSIZE_ANY(raw);
+
+	*isNew = cache == NULL || cache->convert != convert || cache->rawSize != rawSize ||
+			 memcmp(cache->raw, raw, rawSize) != 0;
+
+	if (!*isNew) {
+		return cache;
+	}
+
+	MtreePivots* pivots = NULL;
+
+	if (cache != NULL) {
+		pivots = cache->pivots;
+		if (cache->prepared != NULL) {
+			pfree(cache->prepared);
+		}
+		if (cache->convert != NULL) {
+			pfree(cache->query);
+		}
+		if (cache->sharedQuery != NULL) {
+			pfree(cache->sharedQuery);
+		}
+		pfree(cache);
+	}
+
+	Size rawSpace = MAXALIGN(rawSize);
+	Size size = 0;
+	struct varlena* query = NULL;
+
+	if (convert == NULL) {
+		query = PG_DETOAST_DATUM_PACKED(queryDatum);
+		size = VARSIZE_ANY_EXHDR(query);
+	}
+
+	cache = (MtreeQueryCache*)MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt,
+													  offsetof(MtreeQueryCache, data) + rawSpace + VARHDRSZ + size);
+	cache->pivots = pivots;
+	cache->generation = ++queryGeneration;
+	cache->raw = cache->data;
+	cache->rawSize = rawSize;
+	memcpy(cache->raw, raw, rawSize);
+	cache->convert = convert;
+
+	if (convert == NULL) {
+		cache->query = cache->data + rawSpace;
+		SET_VARSIZE(cache->query, VARHDRSZ + size);
+		memcpy(VARDATA(cache->query), VARDATA_ANY(query), size);
+	} else {
+		MemoryContext oldContext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+		cache->query = DatumGetPointer(DirectFunctionCall1(convert, queryDatum));
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	fcinfo->flinfo->fn_extra = cache;
+
+	return cache;
+}
+
+/*
+ * Sorts the fields of a key layout that are not stored by their offsets and
+ * returns their number.
+ */
+static int mtree_key_fields(const MtreeKeyLayout* layout, Size offsets[4], Size sizes[4])
+{
+	int count = 3;
+
+	offsets[0] = layout->coveringRadius;
+	sizes[0] = sizeof(double);
+	offsets[1] = layout->level;
+	sizes[1] = sizeof(int);
+	offsets[2] = layout->parentDistance;
+	sizes[2] = sizeof(double);
+	if (layout->paddingSize > 0) {
+		offsets[count] = layout->padding;
+		sizes[count] = layout->paddingSize;
+		++count;
+	}
+
+	for (int i = 1; i < count; ++i) {
+		for (int j = i; j > 0 && offsets[j - 1] > offsets[j]; --j) {
+			Size offset = offsets[j];
+			Size size = sizes[j];
+			offsets[j] = offsets[j - 1];
+			sizes[j] = sizes[j - 1];
+			offsets[j - 1] = offset;
+			sizes[j - 1] = size;
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Computes the codes of the given coordinates with a single offset and scale,
+ * spreading their range over the 256 codes. Returns false if the coordinates
+ * are not finite, the codes are left undefined then.
+ */
+bool mtree_quantize(const float4* data, int length, MtreeQuantization* quantization)
+{
+	float4 minimum = 0.0f;
+	float4 maximum = 0.0f;
+
+	for (int i = 0; i < length; ++i) {
+		if (!isfinite(data[i])) {
+			return false;
+		}
+		if (i == 0 || data[i] < minimum) {
+			minimum = data[i];
+		}
+		if (i == 0 || data[i] > maximum) {
+			maximum = data[i];
+		}
+	}
+
+	quantization->offset = minimum;
+	quantization->scale = (float4)(((double)maximum - (double)minimum) / 255.0);
+	if (!isfinite(quantization->scale)) {
+		return false;
+	}
+
+	for (int i = 0; i < length; ++i) {
+		double code = 0.0;
+		if (quantization->scale > 0.0f) {
+			code = rint(((double)data[i] - (double)minimum) / (double)quantization->scale);
+		}
+		quantization->codes[i] = (int8)(MIN_2(MAX_2(code, 0.0), 255.0) - 128.0);
+	}
+
+	return true;
+}
+
+/*
+ * Returns the stored form of a key, see MTREE_KEY_INTERNAL. The coordinates of
+ * a key with a quantization are replaced by its codes.
+ */
+void* mtree_key_compact(const void* key, const MtreeKeyLayout* layout, bool isLeaf, bool storeParentDistance,
+						const MtreeQuantization* quantization)
+{
+	const char* source = (const char*)key;
+	Size size = VARSIZE_ANY(key);
+	double coveringRadius;
+	int level;
+	double parentDistance;
+	Size offsets[4];
+	Size sizes[4];
+	uint8 flags = 0;
+
+	memcpy(&coveringRadius, source + layout->coveringRadius, sizeof(double));
+	memcpy(&level, source + layout->level, sizeof(int));
+	memcpy(&parentDistance, source + layout->parentDistance, sizeof(double));
+
+	Size compactSize = size - 2 * sizeof(double) - sizeof(int) - layout->paddingSize + sizeof(uint8);
+	if (!isLeaf) {
+		flags |= MTREE_KEY_INTERNAL;
+		compactSize += sizeof(float4);
+	} else if (coveringRadius != 0.0) {
+		flags |= MTREE_KEY_RADIUS;
+		compactSize += sizeof(double);
+	}
+	if (level != 0) {
+		flags |= MTREE_KEY_LEVEL;
+		compactSize += sizeof(int);
+	}
+	if (storeParentDistance) {
+		flags |= MTREE_KEY_PARENT_DISTANCE;
+		compactSize += sizeof(double);
+	}
+
+	int32 length = 0;
+	Size end = size;
+	if (quantization != NULL) {
+		memcpy(&length, source + layout->arrayLength, sizeof(int32));
+		flags |= MTREE_KEY_QUANTIZED;
+		compactSize = compactSize + 2 * sizeof(float4) - length * (sizeof(float4) - sizeof(int8));
+		end = layout->data;
+	}
+
+	char* result = (char*)palloc(compactSize);
+	char* destination = result + VARHDRSZ;
+
+	SET_VARSIZE(result, compactSize);
+	*destination++ = (char)flags;
+	if (flags & MTREE_KEY_INTERNAL) {
+		float4 radius = mtree_distance_round_up(coveringRadius);
+		memcpy(destination, &radius, sizeof(float4));
+		destination += sizeof(float4);
+	} else if (flags & MTREE_KEY_RADIUS) {
+		memcpy(destination, &coveringRadius, sizeof(double));
+		destination += sizeof(double);
+	}
+	if (flags & MTREE_KEY_LEVEL) {
+		memcpy(destination, &level, sizeof(int));
+		destination += sizeof(int);
+	}
+	if (flags & MTREE_KEY_PARENT_DISTANCE) {
+		memcpy(destination, &parentDistance, sizeof(double));
+		destination += sizeof(double);
+	}
+
+	int fieldCount = mtree_key_fields(layout, offsets, sizes);
+
+	Size position = VARHDRSZ;
+	for (int i = 0; i < fieldCount; ++i) {
+		memcpy(destination, source + position, offsets[i] - position);
+		destination += offsets[i] - position;
+		position = offsets[i] + sizes[i];
+	}
+	memcpy(destination, source + position, end - position);
+
+	if (quantization != NULL) {
+		destination += end - position;
+		memcpy(destination, &quantization->offset, sizeof(float4));
+		destination += sizeof(float4);
+		memcpy(destination, &quantization->scale, sizeof(float4));
+		destination += sizeof(float4);
+		memcpy(destination, quantization->codes, length * sizeof(int8));
+		destination += length * sizeof(int8);
+		position = layout->data + length * sizeof(float4);
+		memcpy(destination, source + position, size - position);
+	}
+
+	return result;
+}
+
+/*
+ * Returns the full form of a stored key. The parentDistance is zero unless
+ * it was stored, which is reported in hasParentDistance.
+ */
+void* mtree_key_expand(const void* compact, const MtreeKeyLayout* layout, bool* hasParentDistance)
+{
+	const char* source = (const char*)VARDATA_ANY(compact);
+	Size compactSize = VARSIZE_ANY_EXHDR(compact);
+	uint8 flags = (uint8)*source++;
+	double coveringRadius = 0.0;
+	int level = 0;
+	double parentDistance = 0.0;
+	Size offsets[4];
+	Size sizes[4];
+
+	--compactSize;
+	if (flags & MTREE_KEY_INTERNAL) {
+		float4 radius;
+		memcpy(&radius, source, sizeof(float4));
+		coveringRadius = radius;
+		source += sizeof(float4);
+		compactSize -= sizeof(float4);
+	} else if (flags & MTREE_KEY_RADIUS) {
+		memcpy(&coveringRadius, source, sizeof(double));
+		source += sizeof(double);
+		compactSize -= sizeof(double);
+	}
+	if (flags & MTREE_KEY_LEVEL) {
+		memcpy(&level, source, sizeof(int));
+		source += sizeof(int);
+		compactSize -= sizeof(int);
+	}
+	if (flags & MTREE_KEY_PARENT_DISTANCE) {
+		memcpy(&parentDistance, source, sizeof(double));
+		source += sizeof(double);
+		compactSize -= sizeof(double);
+	}
+	*hasParentDistance = (flags & MTREE_KEY_PARENT_DISTANCE) != 0;
+
+	int fieldCount = mtree_key_fields(layout, offsets, sizes);
+	Size size = VARHDRSZ + compactSize + 2 * sizeof(double) + sizeof(int) + layout->paddingSize;
+	Size end = size;
+	int32 length = 0;
+	MtreeQuantization quantization;
+
+	if (flags & MTREE_KEY_QUANTIZED) {
+		/* arrayLength precedes the coordinates, past the fields not stored */
+		Size lengthOffset = layout->arrayLength - VARHDRSZ;
+		for (int i = 0; i < fieldCount && offsets[i] < layout->arrayLength; ++i) {
+			lengthOffset -= sizes[i];
+		}
+		memcpy(&length, source + lengthOffset, sizeof(int32));
+		size = size + length * (sizeof(float4) - sizeof(int8)) - 2 * sizeof(float4);
+		end = layout->data;
+	}
+
+	char* result = (char*)palloc0(size);
+
+	SET_VARSIZE(result, size);
+
+	Size position = VARHDRSZ;
+	for (int i = 0; i < fieldCount; ++i) {
+		memcpy(result + position, source, offsets[i] - position);
+		source += offsets[i] - position;
+		position = offsets[i] + sizes[i];
+	}
+	memcpy(result + position, source, end - position);
+
+	if (flags & MTREE_KEY_QUANTIZED) {
+		source += end - position;
+		memcpy(&quantization.offset, source, sizeof(float4));
+		source += sizeof(float4);
+		memcpy(&quantization.scale, source, sizeof(float4));
+		source += sizeof(float4);
+
+		for (int32 i = 0; i < length; ++i) {
+			float4 coordinate = mtree_dequantize(&quantization, (int8)source[i]);
+			memcpy(result + layout->data + i * sizeof(float4), &coordinate, sizeof(float4));
+		}
+		source += length * sizeof(int8);
+		position = layout->data + length * sizeof(float4);
+		memcpy(result + position, source, size - position);
+	}
+
+	memcpy(result + layout->coveringRadius, &coveringRadius, sizeof(double));
+	memcpy(result + layout->level, &level, sizeof(int));
+	memcpy(result + layout->parentDistance, &parentDistance, sizeof(double));
+
+	return result;
+}
+
+/*
+ * Returns where the fields of a stored key that follow its header start,
+ * without expanding it. For mtree_float and mtree_int32 this is the value.
+ */
+const char* mtree_key_payload(const void* compact)
+{
+	const char* source = (const char*)VARDATA_ANY(compact);
+	uint8 flags = (uint8)*source++;
+
+	if (flags & MTREE_KEY_INTERNAL) {
+		source += sizeof(float4);
+	} else if (flags & MTREE_KEY_RADIUS) {
+		source += sizeof(double);
+	}
+	if (flags & MTREE_KEY_LEVEL) {
+		source += sizeof(int);
+	}
+	if (flags & MTREE_KEY_PARENT_DISTANCE) {
+		source += sizeof(double);
+	}
+
+	return source;
+}
+
+/*
+ * Decides whether two full keys are the same for the GiST same support
+ * function: their level, radius, center and rings all have to match, so
+ * the whole values are compared. Keys are built in zeroed memory, so the
+ * padding does not differ.
+ */
+bool mtree_key_identical(const void* first, const void* second)
+{
+	Size size = VARSIZE_ANY(first);
+
+	return size == VARSIZE_ANY(second) && memcmp(first, second, size) == 0;
+}
+
+/*
+ * Sends the header fields of a value in the binary format shared by every
+ * type: the level and the covering radius, in network byte order like the
+ * built-in types. The parentDistance is recomputed by the receiver.
+ */
+void mtree_send_header(StringInfo buffer, int level, double coveringRadius)
+{
+	pq_sendint32(buffer, (uint32)level);
+	pq_sendfloat8(buffer, coveringRadius);
+}
+
+void mtree_receive_header(StringInfo buffer, int* level, double* coveringRadius)
+{
+	*level = (int)pq_getmsgint(buffer, 4);
+	*coveringRadius = pq_getmsgfloat8(buffer);
+
+	if (*level < 0) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_BINARY_REPRESENTATION), errmsg("The level can't be negative!"));
+	}
+	if (!(*coveringRadius >= 0.0)) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_BINARY_REPRESENTATION), errmsg("The radius can't be negative!"));
+	}
+	if (!isfinite(*coveringRadius)) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_BINARY_REPRESENTATION), errmsg("The radius has to be finite!"));
+	}
+}
+
+/*
+ * Receives a coordinate, which the text input and the casts only accept
+ * when it is finite.
+ */
+float4 mtree_receive_coordinate(StringInfo buffer)
 {
-	for (int i = 0; i < size; ++i) {
-		for (int j = 0; j < size; ++j) {
-			distances[i * size + j] = -1;
+	float4 coordinate = pq_getmsgfloat4(buffer);
+
+	if (!isfinite(coordinate)) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+				errmsg("The value can only contain finite single precision numbers."));
+	}
+
+	return coordinate;
+}
+
+/*
+ * Receives the number of elements of an array value, between minimum and
+ * maximum, each taking at least elementSize bytes of the rest of the message,
+ * so that a corrupt length never causes a huge allocation.
+ */
+int mtree_receive_length(StringInfo buffer, int minimum, int maximum, Size elementSize)
+{
+	int length = (int)pq_getmsgint(buffer, 4);
+
+	if (length < minimum || length > maximum || (Size)length * elementSize > (Size)(buffer->len - buffer->cursor)) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+				errmsg("Invalid array length %d in binary input!", length));
+	}
+
+	return length;
+}
+
+/*
+ * Returns the number of elements of a native array cast to an M-tree type,
+ * which has to be a non-empty one-dimensional array without NULLs.
+ */
+int mtree_native_array_length(ArrayType* array)
+{
+	if (ARR_NDIM(array) > 1) {
+		ereport(ERROR, errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR), errmsg("The array has to be one-dimensional!"));
+	}
+	if (array_contains_nulls(array)) {
+		ereport(ERROR, errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("The array can't contain NULLs!"));
+	}
+
+	int length = ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array));
+	if (length == 0) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("The array can't be empty!"));
+	}
+
+	return length;
+}
+
+/*
+ * Distance computed by the last consistent call, kept for the distance call
+ * that GiST makes right after it on the same entry when a scan both filters
+ * and orders. The two calls have separate query caches, so the memo lives in
+ * the backend. Each call gets its own decompressed copy of the key, so the
+ * memo keeps copies of the key and of the query and compares their bytes
+ * instead of pointers. Scans without ordering never call distance, so the
+ * key is only copied once a distance call has asked for the query.
+ */
+typedef struct {
+	Size size;
+	Size capacity;
+	char* bytes;
+} MtreeMemoCopy;
+
+static struct {
+	bool valid;
+	bool ordered;
+	uint64 queryGeneration;
+	uint32 queryHash;
+	MtreeMemoCopy query;
+	MtreeMemoCopy key;
+	double distance;
+} distanceMemo;
+
+static void mtree_memo_copy(MtreeMemoCopy* copy, const void* value)
+{
+	Size size = VARSIZE_ANY(value);
+
+	if (size > copy->capacity) {
+		if (copy->bytes != NULL) {
+			pfree(copy->bytes);
 		}
+		copy->capacity = MAX_2(size, 2 * copy->capacity);
+		copy->bytes = MemoryContextAlloc(TopMemoryContext, copy->capacity);
+	}
+
+	memcpy(copy->bytes, value, size);
+	copy->size = size;
+}
+
+static inline bool mtree_memo_equals(const MtreeMemoCopy* copy, const void* value)
+{
+	return copy->size == VARSIZE_ANY(value) && memcmp(copy->bytes, value, copy->size) == 0;
+}
+
+/*
+ * Memoizes the distance of a key from the query of a cache. The query is only
+ * copied when it comes from another cache than the previous one, and the key
+ * only when the scan also orders by the distance from the query.
+ */
+void mtree_distance_memo_store(const MtreeQueryCache* cache, const void* key, double distance)
+{
+	if (distanceMemo.queryGeneration != cache->generation) {
+		mtree_memo_copy(&distanceMemo.query, cache->sharedQuery);
+		distanceMemo.queryGeneration = cache->generation;
+		distanceMemo.queryHash = cache->queryHash;
+		distanceMemo.ordered = false;
+	}
+
+	if (!distanceMemo.ordered) {
+		distanceMemo.valid = false;
+		return;
+	}
+
+	mtree_memo_copy(&distanceMemo.key, key);
+	distanceMemo.valid = true;
+	distanceMemo.distance = distance;
+}
+
+/*
+ * Returns the memoized distance of a key from the query of a cache. The
+ * queries of the two calls are compared without their radius, so
+ * x #<# mtree_ball(q, r) ORDER BY x <-> q shares the distance. Their hashes
+ * only reject most other queries quickly. The first lookup of the query of
+ * the memo marks it as ordered, which lets the next calls store their keys.
+ */
+bool mtree_distance_memo_lookup(const MtreeQueryCache* cache, const void* key, double* distance)
+{
+	if (distanceMemo.queryHash != cache->queryHash) {
+		return false;
+	}
+	if (!distanceMemo.ordered) {
+		distanceMemo.ordered = mtree_memo_equals(&distanceMemo.query, cache->sharedQuery);
+		return false;
 	}
+	if (!distanceMemo.valid || !mtree_memo_equals(&distanceMemo.key, key) ||
+		!mtree_memo_equals(&distanceMemo.query, cache->sharedQuery)) {
+		return false;
+	}
+
+	distanceMemo.valid = false;
+	*distance = distanceMemo.distance;
+	return true;
+}
+
+/*
+ * Evaluates the consistent function of a strategy from the distance between
+ * the centers of the query and of a key. Internal keys are consistent if one
+ * of the leaves below them may be. The exact comparison of leaves for
+ * GIST_SN_SAME is left to the caller.
+ */
+bool mtree_distance_consistent(StrategyNumber strategyNumber, bool isLeaf, double distance, double queryRadius,
+							   double keyRadius)
+{
+	switch (strategyNumber) {
+		case GIST_SN_SAME:
+		case GIST_SN_CONTAINS:
+			if (isLeaf) {
+				return distance + queryRadius < keyRadius;
+			}
+			/* a leaf equal to the query may lie on the boundary of the ball */
+			return distance + queryRadius <= keyRadius;
+		case GIST_SN_OVERLAPS:
+			return distance - (keyRadius + queryRadius) < 0;
+		case GIST_SN_CONTAINED_BY:
+			if (isLeaf) {
+				return distance + keyRadius < queryRadius;
+			}
+			return distance - (keyRadius + queryRadius) < 0;
+		default:
+			ereport(ERROR, errcode(ERRCODE_SYNTAX_ERROR),
+					errmsg("Invalid StrategyNumber for consistent function: %u", strategyNumber));
+			return false;
+	}
+}
+
+/*
+ * Decides from a lower bound of the distance between the centers of the query
+ * and of a key whether the consistent function would reject the key, without
+ * computing their distance. The bound is |d(q, o) - d(k, o)| for the reference
+ * object o of the type, so it must be slightly loosened for the rounding
+ * errors of the two distances.
+ */
+bool mtree_lower_bound_excludes(StrategyNumber strategyNumber, bool isLeaf, double lowerBound, double queryRadius,
+								double keyRadius)
+{
+	double threshold;
+
+	switch (strategyNumber) {
+		case GIST_SN_OVERLAPS:
+			threshold = queryRadius + keyRadius;
+			break;
+		case GIST_SN_SAME:
+			if (isLeaf) {
+				return false;
+			}
+			/* fall through */
+		case GIST_SN_CONTAINS:
+			threshold = keyRadius - queryRadius;
+			break;
+		case GIST_SN_CONTAINED_BY:
+			threshold = isLeaf ? queryRadius - keyRadius : queryRadius + keyRadius;
+			break;
+		default:
+			return false;
+	}
+
+	return mtree_exceeds(lowerBound, threshold);
+}
+
+/*
+ * Returns the number of pivots of the index without parsing them.
+ */
+int mtree_pivot_count(FunctionCallInfo fcinfo)
+{
+	if (!PG_HAS_OPCLASS_OPTIONS()) {
+		return 0;
+	}
+
+	MtreeOptions* options = (MtreeOptions*)PG_GET_OPCLASS_OPTIONS();
+	const char* value = GET_STRING_RELOPTION(options, pivots);
+	int count = 0;
+
+	while (value != NULL && count < MTREE_MAX_PIVOTS) {
+		const char* next = strchr(value, MTREE_PIVOT_SEPARATOR);
+		size_t length = next != NULL ? (size_t)(next - value) : strlen(value);
+
+		if (length > 0) {
+			++count;
+		}
+		value = next != NULL ? next + 1 : NULL;
+	}
+
+	return count;
+}
+
+/*
+ * Returns the number of sketch projections of the index and sets dimensions
+ * (if not NULL) to the number of coordinates they cover.
+ */
+int mtree_sketch_count(FunctionCallInfo fcinfo, int* dimensions)
+{
+	if (!PG_HAS_OPCLASS_OPTIONS()) {
+		return 0;
+	}
+
+	MtreeOptions* options = (MtreeOptions*)PG_GET_OPCLASS_OPTIONS();
+
+	if (options->sketch_projections > 0 && options->sketch_dimensions == 0) {
+		ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("The sketch_projections option requires sketch_dimensions to be set!"));
+	}
+	if (dimensions != NULL) {
+		*dimensions = options->sketch_dimensions;
+	}
+
+	return options->sketch_projections;
+}
+
+/*
+ * Returns the pivots of the index, parsed with the input function of the type
+ * and kept in the memory context of the calling function. The result has no
+ * pivots if the option is not set.
+ */
+MtreePivots* mtree_pivots_get(FunctionCallInfo fcinfo, PGFunction input)
+{
+	MtreePivots* pivots =
+		(MtreePivots*)MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt, sizeof(MtreePivots));
+
+	if (!PG_HAS_OPCLASS_OPTIONS()) {
+		return pivots;
+	}
+
+	MtreeOptions* options = (MtreeOptions*)PG_GET_OPCLASS_OPTIONS();
+	char* option = GET_STRING_RELOPTION(options, pivots);
+
+	if (option == NULL) {
+		return pivots;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	char* value = pstrdup(option);
+
+	while (value != NULL && pivots->count < MTREE_MAX_PIVOTS) {
+		char* next = strchr(value, MTREE_PIVOT_SEPARATOR);
+
+		if (next != NULL) {
+			*next++ = '\0';
+		}
+		if (*value != '\0') {
+			/* Input functions may modify their argument. */
+			pivots->values[pivots->count++] = DirectFunctionCall1(input, CStringGetDatum(pstrdup(value)));
+		}
+		value = next;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return pivots;
+}
+
+/*
+ * Decides from the rings of a key whether the consistent function would
+ * reject it, given the distances of the query from the pivots. Every object
+ * covered by the key is within its rings, and every object within the query
+ * ball is at most queryRadius farther or closer to a pivot than the query.
+ * The same holds for the sketch projections, which never exceed distances.
+ */
+bool mtree_rings_exclude(StrategyNumber strategyNumber, bool isLeaf, const MtreeRing* rings,
+						 const double* queryDistances, int count, double queryRadius)
+{
+	for (int i = 0; i < count; ++i) {
+		double lower = rings[i].lower;
+		double upper = rings[i].upper;
+		double distance = queryDistances[i];
+
+		switch (strategyNumber) {
+			case GIST_SN_SAME:
+				if (isLeaf) {
+					return false;
+				}
+				/* fall through */
+			case GIST_SN_CONTAINS:
+				/* The query has to be inside the ball of the key. */
+				if (mtree_exceeds(lower, distance) || mtree_exceeds(distance, upper)) {
+					return true;
+				}
+				break;
+			case GIST_SN_OVERLAPS:
+			case GIST_SN_CONTAINED_BY:
+				if (mtree_exceeds(lower, distance + queryRadius) || mtree_exceeds(distance - queryRadius, upper)) {
+					return true;
+				}
+				break;
+			default:
+				return false;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Returns a lower bound of the distance between the query ball and every
+ * object covered by a key, from the rings of the key.
+ */
+double mtree_rings_distance(const MtreeRing* rings, const double* queryDistances, int count, double queryRadius)
+{
+	double distance = 0.0;
+
+	for (int i = 0; i < count; ++i) {
+		double gap = MAX_2(rings[i].lower - queryDistances[i], queryDistances[i] - rings[i].upper) - queryRadius;
+		distance = MAX_2(distance, gap - MTREE_LOWER_BOUND_TOLERANCE * (1.0 + fabs(gap)));
+	}
+
+	return distance;
+}
+
+/*
+ * Draws a uniformly random pair of distinct entries, left < right.
+ */
+void mtree_random_pair(MtreePickSplitWorkspace* workspace, int size, int* left, int* right)
+{
+	int first = (int)pg_prng_uint64_range(&workspace->random, 0, size - 1);
+	int second = (int)pg_prng_uint64_range(&workspace->random, 0, size - 2);
+
+	if (second >= first) {
+		++second;
+	}
+
+	*left = MIN_2(first, second);
+	*right = MAX_2(first, second);
+}
+
+int mtree_distance_index_cmp(const void* first, const void* second)
+{
+	const MtreeDistanceIndex* a = (const MtreeDistanceIndex*)first;
+	const MtreeDistanceIndex* b = (const MtreeDistanceIndex*)second;
+
+	if (a->distance != b->distance) {
+		return a->distance < b->distance ? -1 : 1;
+	}
+
+	return a->index - b->index;
 }
 
 double overlap_area(double radiusOne, double radiusTwo, double distance)
@@ -5,16 +5,272 @@
 #ifndef __MTREE_UTIL_H__
 #define __MTREE_UTIL_H__
 
+#include "postgres.h"
+#include "fmgr.h"
+#include "access/stratnum.h"
+#include "common/pg_prng.h"
+#include "lib/stringinfo.h"
+#include "utils/array.h"
+
+#include "mtree_gist.h"
+
 #include <math.h>
 #include <stdbool.h>
 #include <string.h>
 
 #define MIN3(a, b, c) ((a) < (b) ? ((a) < (c) ? (a) : (c)) : ((b) < (c) ? (b) : (c)))
 
+/*
+ * Picksplit workspace, kept in the memory context of the picksplit function,
+ * so it is reused by every split of an index build.
+ *
+ * It caches the distances between the entries of a split: only the upper
+ * triangle is stored, in single precision, and unknown cells are NaN. Splits
+ * too large for maintenance_work_mem are not cached.
+ *
+ * It also holds the random generator of the split strategies, seeded once
+ * with the random_seed option, so that building an index from the same data
+ * always gives the same tree.
+ */
+typedef struct {
+	int size;
+	bool cached;
+	size_t capacity;
+	float4* distances;
+	pg_prng_state random;
+} MtreePickSplitWorkspace;
+
+/*
+ * Distance of an entry of a split, for sorting the entries by distance.
+ */
+typedef struct {
+	double distance;
+	int index;
+} MtreeDistanceIndex;
+
+/*
+ * Pivot objects of an index, parsed from the pivots operator class option.
+ */
+typedef struct {
+	int count;
+	Datum values[MTREE_MAX_PIVOTS];
+} MtreePivots;
+
+/*
+ * Interval of the distances between a pivot and every object covered by a
+ * key. Keys of an index with pivots end with one ring per pivot, followed by
+ * one ring per sketch projection, holding the interval of the projections of
+ * the objects instead.
+ */
+typedef struct {
+	float4 lower;
+	float4 upper;
+} __attribute__((packed, aligned(1))) MtreeRing;
+
+/*
+ * Levenshtein pattern of a string of at most 64 bytes for the bit-parallel
+ * algorithm of Myers: the positions of every byte value in the string. The
+ * length is -1 for longer strings, whose distances are computed by
+ * string_distance.
+ */
+typedef struct {
+	int length;
+	uint64 positions[256];
+} MtreeStringPattern;
+
+#define MTREE_STRING_PATTERN_MAX_LENGTH 64
+
+/*
+ * Query of an index scan, kept in the memory context of the calling support
+ * function. The raw query datum is copied and compared bytewise on every
+ * call, like pg_trgm does, so the query is detoasted and preprocessed only
+ * when the scan changes its query. A query of a cross-type operator, e.g. a
+ * float4[], is converted to the key type once, by the function given.
+ */
+typedef struct {
+	/* Distance of the query from the reference object of its type */
+	double referenceDistance;
+	/* Pivots of the index, parsed once and kept for every query */
+	MtreePivots* pivots;
+	/* Distances of the query from the pivots, then its sketch projections */
+	int ringCount;
+	double ringValues[MTREE_MAX_RINGS];
+	/* Preprocessed form of the query specific to its type, or NULL */
+	void* prepared;
+	/* The query without its radius and its hash, see mtree_distance_memo_store */
+	char* sharedQuery;
+	uint32 queryHash;
+	/* Distinguishes the queries of every cache of the backend */
+	uint64 generation;
+	/* The query datum as passed to the function, possibly toasted */
+	Size rawSize;
+	char* raw;
+	/* Conversion of the query to the key type, or NULL */
+	PGFunction convert;
+	/* The query as a detoasted value of the key type */
+	char* query;
+	/* The raw datum, followed by the detoasted query unless it was converted */
+	char data[FLEXIBLE_ARRAY_MEMBER];
+} MtreeQueryCache;
+
+/*
+ * Stored form of a key. compress drops the header fields of a key that are
+ * implied by its position in the tree, decompress restores them:
+ *
+ *	  varlena header, flags, [float4 coveringRadius | double coveringRadius],
+ *	  [int level], [double parentDistance], the remaining bytes of the key
+ *
+ * Internal keys store their radius in single precision, rounded upwards so
+ * the ball still covers its children. Leaf keys store no radius unless it is
+ * nonzero, no level unless it is nonzero and no parentDistance unless the
+ * type asks for it, the others recompute it from the key.
+ *
+ * The float coordinates of a quantized key are stored as float4 offset,
+ * float4 scale and one int8 code per coordinate, see MtreeQuantization.
+ */
+#define MTREE_KEY_INTERNAL 0x01
+#define MTREE_KEY_RADIUS 0x02
+#define MTREE_KEY_LEVEL 0x04
+#define MTREE_KEY_PARENT_DISTANCE 0x08
+#define MTREE_KEY_QUANTIZED 0x10
+
+/*
+ * Offsets of the header fields in the full form of a key type, and of its
+ * padding, which is not stored either. Types with float coordinates that can
+ * be quantized also give the offsets of arrayLength and data.
+ */
+typedef struct {
+	Size coveringRadius;
+	Size level;
+	Size parentDistance;
+	Size padding;
+	Size paddingSize;
+	Size arrayLength;
+	Size data;
+} MtreeKeyLayout;
+
+/*
+ * Scalar quantization of the coordinates of a center: coordinate j is
+ * approximated by offset + scale * (codes[j] + 128), see mtree_dequantize.
+ */
+typedef struct {
+	float4 offset;
+	float4 scale;
+	int8* codes;
+} MtreeQuantization;
+
 double string_distance(const char*, const char*);
-void init_distances(const int, double*);
+void* mtree_key_compact(const void*, const MtreeKeyLayout*, bool, bool, const MtreeQuantization*);
+void* mtree_key_expand(const void*, const MtreeKeyLayout*, bool*);
+const char* mtree_key_payload(const void*);
+bool mtree_key_identical(const void*, const void*);
+void mtree_send_header(StringInfo, int, double);
+void mtree_receive_header(StringInfo, int*, double*);
+float4 mtree_receive_coordinate(StringInfo);
+int mtree_receive_length(StringInfo, int, int, Size);
+int mtree_native_array_length(ArrayType*);
+void mtree_string_pattern_init(MtreeStringPattern*, const char*);
+double mtree_string_pattern_distance(const MtreeStringPattern*, const char*);
+MtreeQueryCache* mtree_query_cache_get(FunctionCallInfo, Datum, PGFunction, bool*);
+void mtree_distance_memo_store(const MtreeQueryCache*, const void*, double);
+bool mtree_distance_memo_lookup(const MtreeQueryCache*, const void*, double*);
+bool mtree_lower_bound_excludes(StrategyNumber, bool, double, double, double);
+bool mtree_distance_consistent(StrategyNumber, bool, double, double, double);
+int mtree_pivot_count(FunctionCallInfo);
+int mtree_sketch_count(FunctionCallInfo, int*);
+MtreePivots* mtree_pivots_get(FunctionCallInfo, PGFunction);
+bool mtree_rings_exclude(StrategyNumber, bool, const MtreeRing*, const double*, int, double);
+double mtree_rings_distance(const MtreeRing*, const double*, int, double);
+int mtree_distance_index_cmp(const void*, const void*);
+MtreePickSplitWorkspace* mtree_picksplit_workspace_get(FunctionCallInfo, int, int);
+void mtree_random_pair(MtreePickSplitWorkspace*, int, int*, int*);
 double overlap_area(double, double, double);
 
+/*
+ * Returns the cached distance cell of entries i and j (i != j), or NULL if
+ * the split was too large for the workspace and distances are not cached.
+ */
+static inline float4* mtree_distance_matrix_cell(MtreePickSplitWorkspace* workspace, int i, int j)
+{
+	if (!workspace->cached) {
+		return NULL;
+	}
+
+	if (i > j) {
+		int swap = i;
+		i = j;
+		j = swap;
+	}
+
+	return &workspace->distances[(size_t)i * (2 * workspace->size - i - 1) / 2 + (j - i - 1)];
+}
+
+/*
+ * Rounds a distance to single precision upwards, so that covering radii
+ * computed from cached distances never shrink.
+ */
+static inline float4 mtree_distance_round_up(double distance)
+{
+	float4 rounded = (float4)distance;
+
+	if ((double)rounded < distance) {
+		rounded = nextafterf(rounded, INFINITY);
+	}
+
+	return rounded;
+}
+
+/*
+ * Rounds a distance to single precision downwards, for the lower ends of
+ * rings.
+ */
+static inline float4 mtree_distance_round_down(double distance)
+{
+	float4 rounded = (float4)distance;
+
+	if ((double)rounded > distance) {
+		rounded = nextafterf(rounded, -INFINITY);
+	}
+
+	return rounded;
+}
+
+/*
+ * Returns the rings at the end of a key of an index with pivots or sketch
+ * projections.
+ */
+static inline MtreeRing* mtree_key_rings(const void* key, int ringCount)
+{
+	return (MtreeRing*)((char*)key + VARSIZE_ANY(key) - ringCount * sizeof(MtreeRing));
+}
+
+/*
+ * Returns the signs of the coordinates 64 * block to 64 * block + 63 in the
+ * given sketch projection, one bit per coordinate. The bits are a hash of
+ * their position (the splitmix64 finalizer), so every key and query of an
+ * index use the same projections without storing them.
+ */
+static inline uint64 mtree_sketch_signs(int projection, int block)
+{
+	uint64 bits = (((uint64)projection << 32) | (uint32)block) + UINT64CONST(0x9E3779B97F4A7C15);
+
+	bits = (bits ^ (bits >> 30)) * UINT64CONST(0xBF58476D1CE4E5B9);
+	bits = (bits ^ (bits >> 27)) * UINT64CONST(0x94D049BB133111EB);
+
+	return bits ^ (bits >> 31);
+}
+
+/*
+ * Returns the coordinate represented by a quantization code. The product is
+ * exact in double precision, so compress and decompress agree on the result
+ * whatever the compiler contracts.
+ */
+static inline float4 mtree_dequantize(const MtreeQuantization* quantization, int8 code)
+{
+	return (float4)((double)quantization->offset + (double)quantization->scale * ((int)code + 128));
+}
+
+bool mtree_quantize(const float4*, int, MtreeQuantization*);
 unsigned char get_array_length(const char*, const size_t);
 
 #endif
@@ -1,6 +1,8 @@
 import psycopg2
 import os
 import heapq
+import io
+import struct
 
 THRESHOLD = 0.0001
 KNN_CENTER_POINTS = [3, 8, 10, 23, 45, 56, 67, 87, 99]
@@ -78,6 +80,188 @@ def knn_test(curs, table_name, center_point_id, neighbour_count):
     return curs.fetchall()
 
 
+def range_test(curs, table_name, index_name, center_point_id, radius):
+    center = f"(SELECT ic.point FROM public.{table_name} ic WHERE ic.id = {center_point_id})"
+
+    query = f"""SELECT c.id FROM public.{table_name} c
+                WHERE c.point #<# mtree_ball({center}, {radius}) ORDER BY c.id;"""
+    return index_matches_seqscan(curs, query, f'Index Scan using {index_name}')
+
+
+def scan_results(curs, query, index_scan):
+    # Runs a query either with plain index scans or with a sequential scan.
+    curs.execute(f'''SET enable_seqscan = {'off' if index_scan else 'on'};
+                    SET enable_indexscan = {'on' if index_scan else 'off'};
+                    SET enable_bitmapscan = off;''')
+    curs.execute(f'EXPLAIN {query}')
+    plan = '\n'.join(row[0] for row in curs.fetchall())
+    curs.execute(query)
+    rows = curs.fetchall()
+    curs.execute('RESET enable_seqscan; RESET enable_indexscan; RESET enable_bitmapscan;')
+    return plan, rows
+
+
+def index_matches_seqscan(curs, query, plan_node):
+    plan, index_res = scan_results(curs, query, index_scan=True)
+    _, scan_res = scan_results(curs, query, index_scan=False)
+    return plan_node in plan and index_res == scan_res, index_res, scan_res
+
+
+def queries_match_seqscan(curs, queries, plan_node):
+    result = True
+    index_res = []
+    scan_res = []
+    for query in queries:
+        query_result, query_index_res, query_scan_res = index_matches_seqscan(curs, query, plan_node)
+        if not query_result:
+            result = False
+            index_res += [query] + query_index_res
+            scan_res += [query] + query_scan_res
+    return result, index_res, scan_res
+
+
+def line_table(curs, table_name, type):
+    # Points of the segment from (0, -1) to (0, 1).
+    curs.execute(f'DROP TABLE IF EXISTS public.{table_name};')
+    curs.execute(f'CREATE TABLE public.{table_name} (id serial primary key, point {type});')
+    curs.execute(f"INSERT INTO public.{table_name} (point) SELECT ('0,' || i / 1000.0)::{type} FROM generate_series(-1000, 1000) i;")
+
+
+def ball_queries(table_name, type, centers, radius, neighbour_count):
+    queries = []
+    for center in centers:
+        queries.append(f"SELECT id FROM public.{table_name} WHERE point #<# mtree_ball('{center}'::{type}, {radius}) ORDER BY id;")
+        queries.append(f"SELECT id, point <-> '{center}'::{type} FROM public.{table_name} ORDER BY point <-> '{center}'::{type}, id LIMIT {neighbour_count};")
+    return queries
+
+
+def random_table(curs, table_name, type, rows, dimensions):
+    # Vectors of random coordinates in [0, 1), or in [0, 1000) for integers, the same ones on every run.
+    coordinate = 'floor(random() * 1000)::int' if 'int32' in type else 'round(random()::numeric, 4)'
+    curs.execute(f'DROP TABLE IF EXISTS public.{table_name};')
+    curs.execute(f'CREATE TABLE public.{table_name} (id serial primary key, point {type});')
+    curs.execute('SELECT setseed(0.5);')
+    curs.execute(f"""INSERT INTO public.{table_name} (point)
+                     SELECT array_to_string(ARRAY(SELECT {coordinate} FROM generate_series(1, {dimensions}) WHERE i > 0), ',')::{type}
+                     FROM generate_series(1, {rows}) i;""")
+
+
+def table_points(curs, table_name, ids):
+    curs.execute(f'SELECT point::text FROM public.{table_name} WHERE id = ANY(%s) ORDER BY id;', (ids,))
+    return [row[0] for row in curs.fetchall()]
+
+
+def copy_frozen(curs, source_query, table_name):
+    # Copies rows into a table created in this transaction. COPY FREEZE marks
+    # its pages all-visible, so index-only scans need no heap access.
+    buffer = io.BytesIO()
+    curs.copy_expert(f'COPY ({source_query}) TO STDOUT (FORMAT binary);', buffer)
+    buffer.seek(0)
+    curs.copy_expert(f'COPY public.{table_name} (point) FROM STDIN (FORMAT binary, FREEZE);', buffer)
+    curs.execute(f'ANALYZE public.{table_name};')
+
+
+def raises_error(curs, query):
+    curs.execute('SAVEPOINT expected_error;')
+    try:
+        curs.execute(query)
+    except psycopg2.Error:
+        curs.execute('ROLLBACK TO SAVEPOINT expected_error;')
+        return True
+    curs.execute('RELEASE SAVEPOINT expected_error;')
+    return False
+
+
+def pivots_test(curs):
+    result = True
+    index_res = []
+    scan_res = []
+    builds = [
+        "CREATE INDEX pivots_test_index ON public.pivots_test USING gist (point gist_mtree_float_array_ops (pivots = '10,0;0,10'));",
+        "SELECT mtree_bulk_build('pivots_test_index', 'public.pivots_test', 'point', NULL, NULL, 4);",
+    ]
+
+    for build in builds:
+        line_table(curs, 'pivots_test', 'mtree_float_array')
+        curs.execute(build)
+        # These fall into the balls of the leaves, but outside the rings around (10, 0).
+        curs.execute("INSERT INTO public.pivots_test (point) SELECT ('-0.01,' || i / 100.0)::mtree_float_array FROM generate_series(-100, 100) i;")
+
+        queries = ball_queries('pivots_test', 'mtree_float_array', ['-0.01,0.5', '-0.01,-0.255', '0,0.1'], 0.005, 10)
+        build_result, build_index_res, build_scan_res = queries_match_seqscan(curs, queries, 'using pivots_test_index')
+        if not build_result:
+            result = False
+            index_res += build_index_res
+            scan_res += build_scan_res
+
+    curs.execute('DROP TABLE public.pivots_test;')
+    return result, index_res, scan_res
+
+
+def legacy_bytes(type, value):
+    # The bytes of a value of version 1.0 after its varlena header, which
+    # overwrote the first 4 bytes of the packed struct.
+    if type == 'mtree_float':
+        return struct.pack('<ddf', 0.0, 0.0, value)
+    if type == 'mtree_int32':
+        return struct.pack('<ddi', 0.0, 0.0, value)
+    if type == 'mtree_float_array':
+        return bytes(4) + struct.pack(f'<dBi{len(value)}f', 0.0, len(value), 0, *value) + bytes(4 * len(value) + 1)
+    if type == 'mtree_int32_array':
+        return struct.pack(f'<ddB{len(value)}i', 0.0, 0.0, len(value), *value) + bytes(4 * len(value) + 1)
+    if type == 'mtree_text':
+        return bytes(4) + struct.pack('<di', 0.0, 0) + bytes(4) + value.encode() + bytes(1)
+    if type == 'mtree_text_array':
+        elements = b''.join(element.encode().ljust(128, b'\0') for element in value)
+        return bytes(4) + struct.pack('<diB', 0.0, 0, len(value)) + elements + bytes(1)
+
+
+def upgrade_test(curs):
+    values = [
+        ('mtree_float', [2.5, -0.125, 1e20]),
+        ('mtree_int32', [42, -7, 2147483647]),
+        ('mtree_float_array', [[0.5, -2.0, 3.25], [1.0], [0.0, 0.0, 0.0, 4.5]]),
+        ('mtree_int32_array', [[1, -2, 3], [2147483647], [0, 5, -5, 10]]),
+        ('mtree_text', ['kitten', 'a', 'sitting']),
+        ('mtree_text_array', [['kitten', 'sitting'], ['a'], ['x' * 127, 'b', 'c']]),
+    ]
+
+    curs.execute("CREATE EXTENSION mtree_gist VERSION '1.0';")
+    for type, type_values in values:
+        curs.execute(f'CREATE TABLE public.upgrade_{type} (id serial primary key, point {type});')
+        curs.execute(f'CREATE CAST (bytea AS {type}) WITHOUT FUNCTION;')
+        for value in type_values:
+            curs.execute(f'INSERT INTO public.upgrade_{type} (point) VALUES (%s::bytea::{type});',
+                         (psycopg2.Binary(legacy_bytes(type, value)),))
+        curs.execute(f'DROP CAST (bytea AS {type});')
+
+    curs.execute("ALTER EXTENSION mtree_gist UPDATE TO '1.1';")
+
+    upgraded_res = []
+    expected_res = []
+    for type, type_values in values:
+        curs.execute(f'SELECT id, point::text FROM public.upgrade_{type} ORDER BY id;')
+        upgraded_res += curs.fetchall()
+        for i, value in enumerate(type_values):
+            literal = ','.join(map(str, value)) if isinstance(value, list) else str(value)
+            curs.execute(f'SELECT %s::{type}::text;', (literal,))
+            expected_res.append((i + 1, curs.fetchone()[0]))
+
+    # parentDistance was lost in 1.0, the index prunes with the recomputed one.
+    result = upgraded_res == expected_res
+    for type, _ in values:
+        create_index(curs=curs, structure="mtree", index_name=f'upgrade_{type}_index', table_name=f'upgrade_{type}', type=type)
+        curs.execute(f'SELECT a.point <-> b.point FROM public.upgrade_{type} a, public.upgrade_{type} b WHERE a.id = 1 AND b.id = 2;')
+        range_result, index_res, scan_res = range_test(curs=curs, table_name=f'upgrade_{type}', index_name=f'upgrade_{type}_index', center_point_id=1, radius=float(curs.fetchone()[0]))
+        if not range_result:
+            result = False
+            upgraded_res += index_res
+            expected_res += scan_res
+
+    curs.execute('DROP EXTENSION mtree_gist CASCADE;')
+    return result, upgraded_res, expected_res
+
+
 def cleanup(curs, tables, indexes):
     query = ''
     for table_name in tables:
@@ -191,6 +375,430 @@ def print_result(result, mtree_res, rtree_res):
         print()
 
 
+def boundary_test(curs):
+    result = True
+    index_res = []
+    scan_res = []
+
+    # Large coordinates, where single precision squares make a visible error,
+    # and balls whose radius is exactly the distance of a row.
+    for dimensions in [1, 2]:
+        curs.execute('DROP TABLE IF EXISTS public.boundary_test;')
+        curs.execute('CREATE TABLE public.boundary_test (id serial primary key, point mtree_float_array);')
+        curs.execute('SELECT setseed(0.5);')
+        curs.execute(f"""INSERT INTO public.boundary_test (point)
+                         SELECT array_to_string(ARRAY(SELECT round((random() * 2000)::numeric, 3) FROM generate_series(1, {dimensions}) WHERE i > 0), ',')::mtree_float_array
+                         FROM generate_series(1, 5000) i;""")
+        curs.execute('CREATE INDEX boundary_test_index ON public.boundary_test USING gist (point gist_mtree_float_array_ops);')
+        curs.execute('ANALYZE public.boundary_test;')
+
+        queries = []
+        for center_id, row_id in [(1, 2), (3, 4), (5, 6), (7, 8), (9, 10)]:
+            curs.execute('SELECT a.point::text, a.point <-> b.point FROM public.boundary_test a, public.boundary_test b WHERE a.id = %s AND b.id = %s;',
+                         (center_id, row_id))
+            center, radius = curs.fetchone()
+            for operator in ['#<#', '#&#']:
+                queries.append(f"SELECT id FROM public.boundary_test WHERE point {operator} mtree_ball('{center}'::mtree_float_array, {radius!r}) ORDER BY id;")
+
+        dimensions_result, dimensions_index_res, dimensions_scan_res = queries_match_seqscan(curs, queries, 'using boundary_test_index')
+        if not dimensions_result:
+            result = False
+            index_res += dimensions_index_res
+            scan_res += dimensions_scan_res
+
+    curs.execute('DROP TABLE public.boundary_test;')
+    return result, index_res, scan_res
+
+
+def high_dimension_test(curs):
+    result = True
+    index_res = []
+    scan_res = []
+    # Past the former limit of 255 coordinates, with and without a remainder after the partial sums.
+    tables = [
+        ('mtree_float_array', 768, 10.9),
+        ('mtree_float_array', 771, 10.9),
+        ('mtree_int32_array', 768, 10900),
+        ('mtree_int32_array', 771, 10900),
+    ]
+
+    for type, dimensions, radius in tables:
+        random_table(curs, 'high_dimension_test', type, 2000, dimensions)
+        curs.execute(f"""SELECT count(*) FROM public.high_dimension_test
+                         WHERE encode({type}_send(point::text::{type}), 'hex') != encode({type}_send(point), 'hex')
+                            OR array_length(string_to_array(point::text, ','), 1) != %s;""", (dimensions,))
+        mismatches = curs.fetchone()[0]
+        if mismatches != 0:
+            result = False
+            index_res.append(f'{mismatches} values of {dimensions} coordinates changed by the text format')
+            scan_res.append('0')
+
+        curs.execute(f'CREATE INDEX high_dimension_test_index ON public.high_dimension_test USING gist (point gist_{type}_ops);')
+        curs.execute('ANALYZE public.high_dimension_test;')
+        queries = ball_queries('high_dimension_test', type, table_points(curs, 'high_dimension_test', [1, 2, 3]), radius, 10)
+        type_result, type_index_res, type_scan_res = queries_match_seqscan(curs, queries, 'using high_dimension_test_index')
+        if not type_result:
+            result = False
+            index_res += [f'{type} {dimensions}'] + type_index_res
+            scan_res += [f'{type} {dimensions}'] + type_scan_res
+
+    curs.execute('DROP TABLE public.high_dimension_test;')
+    return result, index_res, scan_res
+
+
+def quantize_test(curs):
+    random_table(curs, 'quantize_test', 'mtree_float_array', 5000, 16)
+    curs.execute("""CREATE INDEX quantize_test_index ON public.quantize_test USING gist (
+        point gist_mtree_float_array_ops (quantize = true, union_strategy = 'MinimumEnclosingBall'));""")
+
+    queries = ball_queries('quantize_test', 'mtree_float_array', table_points(curs, 'quantize_test', [1, 2, 3]), 0.8, 10)
+    result, index_res, scan_res = queries_match_seqscan(curs, queries, 'using quantize_test_index')
+
+    # Only mtree_float_array stores quantized centers.
+    random_table(curs, 'quantize_test', 'mtree_int32_array', 10, 16)
+    if not raises_error(curs, "CREATE INDEX ON public.quantize_test USING gist (point gist_mtree_int32_array_ops (quantize = true));"):
+        result = False
+        index_res.append('quantize accepted for mtree_int32_array')
+
+    curs.execute('DROP TABLE public.quantize_test;')
+    return result, index_res, scan_res
+
+
+def sketch_test(curs):
+    result = True
+    index_res = []
+    scan_res = []
+    # The vectors have 16 coordinates, more than 8 and fewer than 64 sketch dimensions.
+    indexes = [
+        ('mtree_float_array', 'sketch_projections = 8, sketch_dimensions = 8', 0.8),
+        ('mtree_float_array', 'sketch_projections = 16, sketch_dimensions = 64', 0.8),
+        ('mtree_int32_array', 'sketch_projections = 8, sketch_dimensions = 8', 600),
+        ('mtree_int32_array', 'sketch_projections = 16, sketch_dimensions = 64', 600),
+    ]
+
+    for type, options, radius in indexes:
+        random_table(curs, 'sketch_test', type, 5000, 16)
+        curs.execute(f'CREATE INDEX sketch_test_index ON public.sketch_test USING gist (point gist_{type}_ops ({options}));')
+        queries = ball_queries('sketch_test', type, table_points(curs, 'sketch_test', [1, 2, 3]), radius, 10)
+        index_result, options_index_res, options_scan_res = queries_match_seqscan(curs, queries, 'using sketch_test_index')
+        if not index_result:
+            result = False
+            index_res += [options] + options_index_res
+            scan_res += [options] + options_scan_res
+
+    # The other types have no coordinates to project.
+    random_table(curs, 'sketch_test', 'mtree_float', 10, 1)
+    if not raises_error(curs, "CREATE INDEX ON public.sketch_test USING gist (point gist_mtree_float_ops (sketch_projections = 8, sketch_dimensions = 8));"):
+        result = False
+        index_res.append('sketches accepted for mtree_float')
+
+    curs.execute('DROP TABLE public.sketch_test;')
+    return result, index_res, scan_res
+
+
+def index_only_test(curs):
+    result = True
+    index_res = []
+    scan_res = []
+
+    for type, radius in [('mtree_float_array', 0.05), ('mtree_int32_array', 40)]:
+        random_table(curs, 'index_only_source', type, 5000, 8)
+        # Every fifth value is a ball, the index has to return its radius too.
+        curs.execute('UPDATE public.index_only_source SET point = mtree_ball(point, %s) WHERE id %% 5 = 0;', (radius,))
+        curs.execute('DROP TABLE IF EXISTS public.index_only_test;')
+        curs.execute(f'CREATE TABLE public.index_only_test (point {type});')
+        copy_frozen(curs, 'SELECT point FROM public.index_only_source ORDER BY id', 'index_only_test')
+        curs.execute('CREATE INDEX index_only_test_index ON public.index_only_test USING gist (point);')
+
+        queries = [f"""SELECT encode({type}_send(point), 'hex') FROM public.index_only_test
+                       ORDER BY point <-> '{center}'::{type} LIMIT 10;"""
+                   for center in table_points(curs, 'index_only_source', [1, 5, 7])]
+        type_result, type_index_res, type_scan_res = queries_match_seqscan(curs, queries, 'Index Only Scan using index_only_test_index')
+        if not type_result:
+            result = False
+            index_res += type_index_res
+            scan_res += type_scan_res
+
+    curs.execute('DROP TABLE public.index_only_test; DROP TABLE public.index_only_source;')
+    return result, index_res, scan_res
+
+
+SAMPLE_VALUES = {
+    'mtree_float': ['2.5', '-0.125', '1e+20'],
+    'mtree_int32': ['42', '-7', '2147483647', '-2147483648'],
+    'mtree_float_array': ['0.5,-2,3.25', '0.1,1e+20', '1'],
+    'mtree_int32_array': ['1,-2,3', '2147483647,-2147483648', '0'],
+    'mtree_text': ['kitten', 'sitting', 'x' * 300],
+    'mtree_text_array': ['kitten,sitting', 'a,b,c', 'x' * 127],
+}
+
+
+def copy_binary_value(curs, table_name, value):
+    # Loads one value given as the bytes of its send function with binary COPY.
+    buffer = io.BytesIO(b'PGCOPY\n\xff\r\n\x00' + struct.pack('>ii', 0, 0) + struct.pack('>hi', 1, len(value)) + value + struct.pack('>h', -1))
+    curs.copy_expert(f'COPY public.{table_name} (point) FROM STDIN (FORMAT binary);', buffer)
+
+
+def binary_copy_test(curs):
+    result = True
+    copied_res = []
+    original_res = []
+
+    for type, values in SAMPLE_VALUES.items():
+        curs.execute(f'DROP TABLE IF EXISTS public.binary_source; CREATE TABLE public.binary_source (id serial primary key, point {type});')
+        curs.execute(f'DROP TABLE IF EXISTS public.binary_copy; CREATE TABLE public.binary_copy (id serial primary key, point {type});')
+        for value in values:
+            curs.execute(f'INSERT INTO public.binary_source (point) VALUES (%s::{type});', (value,))
+        # Balls have a radius, which the text format does not show.
+        curs.execute(f'INSERT INTO public.binary_source (point) SELECT mtree_ball(point, 1.5) FROM public.binary_source WHERE id = 1;')
+
+        buffer = io.BytesIO()
+        curs.copy_expert('COPY public.binary_source (id, point) TO STDOUT (FORMAT binary);', buffer)
+        buffer.seek(0)
+        curs.copy_expert('COPY public.binary_copy (id, point) FROM STDIN (FORMAT binary);', buffer)
+
+        query = f"SELECT id, point::text, encode({type}_send(point), 'hex') FROM public.{{}} ORDER BY id;"
+        curs.execute(query.format('binary_copy'))
+        type_copied_res = curs.fetchall()
+        curs.execute(query.format('binary_source'))
+        type_original_res = curs.fetchall()
+        if len(type_original_res) != len(values) + 1 or type_copied_res != type_original_res:
+            result = False
+            copied_res += type_copied_res
+            original_res += type_original_res
+
+    # The text input rejects what is not finite, so the binary input has to as well.
+    nan, inf = float('nan'), float('inf')
+    curs.execute('DROP TABLE IF EXISTS public.binary_copy; CREATE TABLE public.binary_copy (id serial primary key, point mtree_float_array);')
+    copy_binary_value(curs, 'binary_copy', struct.pack('>idi2f', 0, 0.0, 2, 1.5, -2.0))
+    curs.execute('SELECT point::text FROM public.binary_copy;')
+    copied = curs.fetchone()[0]
+    if copied != '1.5,-2':
+        result = False
+        copied_res.append(copied)
+        original_res.append('1.5,-2')
+
+    rejected = [
+        ('mtree_float', struct.pack('>idf', 0, 0.0, nan)),
+        ('mtree_float', struct.pack('>idf', 0, 0.0, -inf)),
+        ('mtree_float', struct.pack('>idf', 0, inf, 1.0)),
+        ('mtree_float_array', struct.pack('>idi2f', 0, 0.0, 2, 1.0, nan)),
+        ('mtree_float_array', struct.pack('>idi2f', 0, 0.0, 2, inf, 1.0)),
+        ('mtree_float_array', struct.pack('>idi2f', 0, inf, 2, 1.0, 1.0)),
+        ('mtree_int32_array', struct.pack('>idi2i', 0, nan, 2, 1, 2)),
+        ('mtree_text', struct.pack('>id', 0, inf) + b'kitten'),
+    ]
+    for type, value in rejected:
+        curs.execute(f'DROP TABLE IF EXISTS public.binary_copy; CREATE TABLE public.binary_copy (id serial primary key, point {type});')
+        curs.execute('SAVEPOINT expected_error;')
+        try:
+            copy_binary_value(curs, 'binary_copy', value)
+        except psycopg2.Error:
+            curs.execute('ROLLBACK TO SAVEPOINT expected_error;')
+            continue
+        curs.execute('RELEASE SAVEPOINT expected_error;')
+        result = False
+        copied_res.append(f'{value.hex()} accepted as {type}')
+        original_res.append('an error')
+
+    curs.execute('DROP TABLE public.binary_source; DROP TABLE public.binary_copy;')
+    return result, copied_res, original_res
+
+
+def text_format_test(curs):
+    result = True
+    output_res = []
+    expected_res = []
+
+    # The shortest text that reads back to the same float4, like real.
+    for type, value in [('mtree_float_array', '0.1,1e+20'), ('mtree_float_array', '1,-2.5,3'),
+                        ('mtree_int32_array', '1,-2,2147483647,-2147483648')]:
+        curs.execute(f'SELECT %s::{type}::text;', (value,))
+        output = curs.fetchone()[0]
+        if output != value:
+            result = False
+            output_res.append(output)
+            expected_res.append(value)
+
+    # Every float4 survives the text format, not only the short ones.
+    for value in ['0.3,-1.1754944e-38,1e-45,3.4028235e+38', '0.1,0.2,0.30000001']:
+        curs.execute(f"SELECT encode(mtree_float_array_send(%s::mtree_float_array), 'hex'), encode(mtree_float_array_send(%s::mtree_float_array::text::mtree_float_array), 'hex');",
+                     (value, value))
+        original, round_trip = curs.fetchone()
+        if original != round_trip:
+            result = False
+            output_res.append(round_trip)
+            expected_res.append(original)
+
+    for type, value in [('mtree_float_array', '1,,2'), ('mtree_float_array', '1,2,'), ('mtree_float_array', 'nan,1'),
+                        ('mtree_float_array', '1,inf'), ('mtree_float_array', '-Infinity'), ('mtree_float_array', '1e39'),
+                        ('mtree_int32_array', '1,,2'), ('mtree_int32_array', '1,2,'), ('mtree_int32_array', '1.5'),
+                        ('mtree_int32_array', '2147483648')]:
+        if not raises_error(curs, f"SELECT '{value}'::{type};"):
+            result = False
+            output_res.append(f'{value} accepted as {type}')
+            expected_res.append('an error')
+
+    return result, output_res, expected_res
+
+
+def native_array_test(curs):
+    result = True
+    index_res = []
+    scan_res = []
+
+    # A cast gives the same value as the text input.
+    casts = [
+        ("ARRAY[0.1, 1e20]::float4[]", 'mtree_float_array', '0.1,1e+20'),
+        ("ARRAY[0.5, -2, 3.25]::float8[]", 'mtree_float_array', '0.5,-2,3.25'),
+        ("ARRAY[1, -2, 2147483647]::int4[]", 'mtree_int32_array', '1,-2,2147483647'),
+        ("ARRAY['kitten', 'sitting']::text[]", 'mtree_text_array', 'kitten,sitting'),
+    ]
+    for array, type, value in casts:
+        curs.execute(f"SELECT encode({type}_send({array}::{type}), 'hex'), encode({type}_send(%s::{type}), 'hex');", (value,))
+        cast, parsed = curs.fetchone()
+        if cast != parsed:
+            result = False
+            index_res.append(f'{array}: {cast}')
+            scan_res.append(f'{value}: {parsed}')
+
+    rejected = [
+        "ARRAY[[1, 2], [3, 4]]::float4[]::mtree_float_array",
+        "ARRAY[1, NULL]::float4[]::mtree_float_array",
+        "ARRAY[[1, 2], [3, 4]]::float8[]::mtree_float_array",
+        "ARRAY[1, NULL]::float8[]::mtree_float_array",
+        "ARRAY[[1, 2], [3, 4]]::int4[]::mtree_int32_array",
+        "ARRAY[1, NULL]::int4[]::mtree_int32_array",
+        "ARRAY[['a', 'b'], ['c', 'd']]::text[]::mtree_text_array",
+        "ARRAY['a', NULL]::text[]::mtree_text_array",
+        "'{}'::float4[]::mtree_float_array",
+    ]
+    for value in rejected:
+        if not raises_error(curs, f'SELECT {value};'):
+            result = False
+            index_res.append(f'{value} accepted')
+            scan_res.append('an error')
+
+    # An array query finds the same rows through the index as its mtree value does without it.
+    tables = [
+        ('mtree_float_array', 'float4[]', 0.05, 8),
+        ('mtree_float_array', 'float8[]', 0.05, 8),
+        ('mtree_int32_array', 'int4[]', 40, 8),
+    ]
+    for type, array_type, radius, dimensions in tables:
+        random_table(curs, 'native_array_test', type, 5000, dimensions)
+        # Every fifth value is a ball, so containment has rows to find.
+        curs.execute('UPDATE public.native_array_test SET point = mtree_ball(point, %s) WHERE id %% 5 = 0;', (radius,))
+        curs.execute(f'CREATE INDEX native_array_test_index ON public.native_array_test USING gist (point gist_{type}_ops);')
+        curs.execute('ANALYZE public.native_array_test;')
+        for center in table_points(curs, 'native_array_test', [1, 2, 3]):
+            array = f"'{{{center}}}'::{array_type}"
+            queries = [
+                (f"SELECT id, point <-> {array} FROM public.native_array_test ORDER BY point <-> {array}, id LIMIT 10;",
+                 f"SELECT id, point <-> '{center}'::{type} FROM public.native_array_test ORDER BY point <-> '{center}'::{type}, id LIMIT 10;"),
+                (f"SELECT id FROM public.native_array_test WHERE point #># {array} ORDER BY id;",
+                 f"SELECT id FROM public.native_array_test WHERE point #># '{center}'::{type} ORDER BY id;"),
+            ]
+            for array_query, type_query in queries:
+                plan, array_res = scan_results(curs, array_query, index_scan=True)
+                _, type_res = scan_results(curs, type_query, index_scan=False)
+                if 'using native_array_test_index' not in plan or array_res != type_res or not type_res:
+                    result = False
+                    index_res += [array_query] + array_res
+                    scan_res += [type_query] + type_res
+        curs.execute('DROP TABLE public.native_array_test;')
+
+    curs.execute('CREATE TABLE public.native_array_test (id serial primary key, point mtree_text_array);')
+    curs.execute("""INSERT INTO public.native_array_test (point)
+                    SELECT ARRAY['word' || i % 97, 'word' || i % 89, 'word' || i % 83]::mtree_text_array FROM generate_series(1, 3000) i;""")
+    curs.execute('CREATE INDEX native_array_test_index ON public.native_array_test USING gist (point gist_mtree_text_array_ops);')
+    curs.execute('ANALYZE public.native_array_test;')
+    for words in [['word1', 'word1', 'word1'], ['word5', 'word7', 'word9']]:
+        array = "ARRAY['" + "', '".join(words) + "']::text[]"
+        for query in [f"SELECT id, point <-> {array} FROM public.native_array_test ORDER BY point <-> {array}, id LIMIT 10;",
+                      f"SELECT id FROM public.native_array_test WHERE point #># {array} ORDER BY id;"]:
+            query_result, query_index_res, query_scan_res = index_matches_seqscan(curs, query, 'using native_array_test_index')
+            if not query_result:
+                result = False
+                index_res += [query] + query_index_res
+                scan_res += [query] + query_scan_res
+    curs.execute('DROP TABLE public.native_array_test;')
+
+    return result, index_res, scan_res
+
+
+def index_pages(curs, index_name):
+    # The pages of an index without their header and special space, which
+    # hold the LSN of the page and of its last split, or only its size when
+    # pageinspect is not installed.
+    curs.execute('SELECT pg_relation_size(%s::regclass) / current_setting(\'block_size\')::int;', (index_name,))
+    pages = [curs.fetchone()[0]]
+    curs.execute('SAVEPOINT index_pages;')
+    try:
+        curs.execute('CREATE EXTENSION IF NOT EXISTS pageinspect;')
+    except psycopg2.Error:
+        curs.execute('ROLLBACK TO SAVEPOINT index_pages;')
+        return pages
+    curs.execute('RELEASE SAVEPOINT index_pages;')
+    curs.execute("""SELECT md5(substr(get_raw_page(%s, block::int), 25, current_setting('block_size')::int - 24 - 16))
+                    FROM generate_series(0, pg_relation_size(%s::regclass) / current_setting('block_size')::int - 1) block;""",
+                 (index_name, index_name))
+    return pages + [row[0] for row in curs.fetchall()]
+
+
+def reproducible_build_test(curs):
+    result = True
+    first_res = []
+    second_res = []
+    # Picksplit only runs when tuples are inserted into an index, the build of a populated table is sorted.
+    options = [
+        "picksplit_strategy = 'Random', random_seed = 7",
+        "picksplit_strategy = 'SamplingMinOverlapArea', sampling_trials = 20, sampling_patience = 5, random_seed = 7",
+        "picksplit_strategy = 'SamplingMinCoveringSum', distribution = 'Balanced', random_seed = 42",
+        "picksplit_strategy = 'MaxDistancePair', distribution = 'Balanced'",
+    ]
+
+    for index_options in options:
+        builds = []
+        for _ in range(2):
+            random_table(curs, 'reproducible_build_source', 'mtree_float_array', 3000, 8)
+            curs.execute('DROP TABLE IF EXISTS public.reproducible_build_test;')
+            curs.execute('CREATE TABLE public.reproducible_build_test (id serial primary key, point mtree_float_array);')
+            curs.execute(f'CREATE INDEX reproducible_build_test_index ON public.reproducible_build_test USING gist (point gist_mtree_float_array_ops ({index_options}));')
+            curs.execute('INSERT INTO public.reproducible_build_test (point) SELECT point FROM public.reproducible_build_source ORDER BY id;')
+
+            queries = ball_queries('reproducible_build_test', 'mtree_float_array',
+                                   table_points(curs, 'reproducible_build_source', [1, 2, 3]), 0.3, 10)
+            query_result, index_res, scan_res = queries_match_seqscan(curs, queries, 'using reproducible_build_test_index')
+            if not query_result:
+                result = False
+                first_res += [index_options] + index_res
+                second_res += [index_options] + scan_res
+            builds.append(index_pages(curs, 'reproducible_build_test_index'))
+
+        if builds[0] != builds[1]:
+            result = False
+            first_res += [index_options] + builds[0]
+            second_res += [index_options] + builds[1]
+
+    curs.execute('DROP TABLE public.reproducible_build_test; DROP TABLE public.reproducible_build_source;')
+    return result, first_res, second_res
+
+
+FEATURE_TESTS = [
+    ("Balls with a row on their boundary", boundary_test),
+    ("Pivots after inserts widening the rings", pivots_test),
+    ("Quantized centers", quantize_test),
+    ("Vectors of hundreds of coordinates", high_dimension_test),
+    ("Sketches", sketch_test),
+    ("Index-only nearest neighbours", index_only_test),
+    ("Binary COPY round trip", binary_copy_test),
+    ("Text format of the arrays", text_format_test),
+    ("Native array casts and queries", native_array_test),
+    ("Reproducible picksplit", reproducible_build_test),
+]
+
+
 def main():
     curs = connect_to_database()
     if curs == None:
@@ -241,6 +849,12 @@ def main():
                         if not result:
                             final_result = False
                         print_result(result, mtree_res, rtree_res)
+
+                        print(f"\t\tRange query around {center_point}:", end="", flush=True)
+                        result, index_res, scan_res = range_test(curs=curs, table_name=mtree_table, index_name=mtree_index, center_point_id=center_point, radius=float(mtree_res[-1][2]))
+                        if not result:
+                            final_result = False
+                        print_result(result, index_res, scan_res)
                 
                 else:
                     create_table(curs=curs, table_name=mtree_table, point_type=f"mtree_{type}")
@@ -267,11 +881,34 @@ def main():
                         if not result:
                             final_result = False
                         print_result(result, mtree_res, rtree_res)
+
+                        print(f"\t\tRange query around {center_point}:", end="", flush=True)
+                        result, index_res, scan_res = range_test(curs=curs, table_name=mtree_table, index_name=mtree_index, center_point_id=center_point, radius=float(mtree_res[-1][2]))
+                        if not result:
+                            final_result = False
+                        print_result(result, index_res, scan_res)
                     
                 print()
         
+        print("────────────────────────────────")
+        print("Options")
+        print("────────────────────────────────")
+        for name, test in FEATURE_TESTS:
+            print(f"\t{name}:", end="", flush=True)
+            result, index_res, scan_res = test(curs)
+            if not result:
+                final_result = False
+            print_result(result, index_res, scan_res)
+
         cleanup(curs, tables, indexes)
 
+        print("────────────────────────────────")
+        print("Upgrade from version 1.0:", end="", flush=True)
+        result, upgraded_res, expected_res = upgrade_test(curs)
+        if not result:
+            final_result = False
+        print_result(result, upgraded_res, expected_res)
+
         if final_result:
             return 0
         else: